@@ -0,0 +1,52 @@
+/**
+ * End-to-end throughput of the simulator and raft library together.
+ *
+ * Usage: bench_cluster [ITERS [CLIENT_RATE]]
+ *
+ * For each cluster size builds a static cluster the same way virtraft does,
+ * runs ITERS iterations (default 20000) with no drops or membership changes,
+ * and reports committed entries and replicated bytes per virtual second, and
+ * the wall clock time spent per virtual second.
+ */
+
+#include "bench_sim.h"
+
+static int __sizes[] = { 3, 5, 7, 9, 31, 101 };
+
+static void __bench(int n_servers, int iters, char* client_rate)
+{
+    char servers[16];
+
+    snprintf(servers, sizeof(servers), "%d", n_servers);
+    char* argv[] = {
+        "bench_cluster", "--servers", servers, "--client_rate", client_rate,
+        "--quiet", NULL
+    };
+
+    __sim_init(len(argv) - 1, argv);
+    double wall_ms_per_vsec = __sim_run(iters);
+    double virtual_sec = __sim_vsec(iters);
+
+    printf("%d\t%d\t%.1f\t%.0f\t%.0f\t%.3f\n",
+           n_servers,
+           sys.n_commits,
+           sys.n_commits / virtual_sec,
+           sys.ae_bytes / virtual_sec,
+           sys.n_msgs / virtual_sec,
+           wall_ms_per_vsec);
+    fflush(stdout);
+
+    __free_system(&sys);
+}
+
+int main(int argc, char **argv)
+{
+    int i, iters = 1 < argc ? atoi(argv[1]) : 20000;
+    char* client_rate = 2 < argc ? argv[2] : "100";
+
+    printf("servers\tcommits\tcommits_per_vsec\tbytes_per_vsec\tmsgs_per_vsec\twall_ms_per_vsec\n");
+    for (i = 0; i < (int)len(__sizes); i++)
+        __bench(__sizes[i], iters, client_rate);
+
+    return 0;
+}
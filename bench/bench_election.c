@@ -0,0 +1,195 @@
+/**
+ * Election convergence: how long a cluster goes without a usable leader.
+ *
+ * Usage: bench_election [TRIALS [ELECTION_TIMEOUT]]
+ *
+ * For every cluster size, drop rate and failure mode, waits for a stable
+ * leader, then either crashes it ("kill"), cuts it off from its peers
+ * ("partition") or hands leadership to a follower ("transfer"), and measures
+ * the virtual time and number of delivered messages until another stable
+ * leader emerges. Transfers that time out are retried. The failed leader is
+ * then restored before the next trial. Defaults to 200 trials per row and a
+ * 500ms election timeout.
+ *
+ * A leader is stable once it is the only leader amongst the reachable
+ * servers and all of them recognise it.
+ */
+
+#include "bench_sim.h"
+
+/* give up on a trial after this many iterations */
+#define TRIAL_MAX_ITERS 2000
+
+enum {
+    FAIL_KILL,
+    FAIL_PARTITION,
+    FAIL_TRANSFER,
+};
+
+static const char* __fail_names[] = { "kill", "partition", "transfer" };
+
+static int __sizes[] = { 3, 5, 7, 9 };
+
+static char* __drop_rates[] = { "0", "10", "20", "30" };
+
+static int __reachable(server_t* sv)
+{
+    return NODE_DISCONNECTED != sv->connect_status && !sv->partitioned;
+}
+
+static server_t* __stable_leader(system_t* sys)
+{
+    server_t* leader = NULL;
+    int i;
+
+    for (i = 0; i < sys->n_servers; i++)
+    {
+        server_t* sv = &sys->servers[i];
+        if (!__reachable(sv) || !raft_is_leader(sv->raft))
+            continue;
+        if (leader)
+            return NULL;
+        leader = sv;
+    }
+
+    if (!leader)
+        return NULL;
+
+    for (i = 0; i < sys->n_servers; i++)
+    {
+        server_t* sv = &sys->servers[i];
+        if (__reachable(sv) &&
+            raft_get_current_leader(sv->raft) != leader->node_id)
+            return NULL;
+    }
+
+    return leader;
+}
+
+/** Run until there is a stable leader
+ * @param old A leader that doesn't count, or NULL
+ * @param mode How the old leader failed
+ * @return the leader, or NULL if one didn't emerge in time */
+static server_t* __wait_for_leader(system_t* sys, server_t* old, int mode)
+{
+    int i;
+
+    for (i = 0; i < TRIAL_MAX_ITERS; i++)
+    {
+        server_t* leader = __stable_leader(sys);
+        if (leader && leader != old)
+            return leader;
+        /* retry transfers that timed out, like an operator would */
+        if (FAIL_TRANSFER == mode && old && raft_is_leader(old->raft))
+            __transfer_leadership(sys, old);
+        __periodic(sys);
+    }
+
+    return NULL;
+}
+
+static void __fail(server_t* sv, int mode)
+{
+    if (FAIL_KILL == mode)
+    {
+        __set_connect_status(sv, NODE_DISCONNECTED);
+        __empty_inbox(sv);
+    }
+    else if (FAIL_PARTITION == mode)
+        sv->partitioned = 1;
+    else
+        __transfer_leadership(&sys, sv);
+}
+
+static void __restore(server_t* sv, int mode)
+{
+    if (FAIL_KILL == mode)
+    {
+        /* a restarted server only keeps what it persisted */
+        __empty_inbox(sv);
+        __set_connect_status(sv, NODE_CONNECTED);
+        raft_become_follower(sv->raft);
+    }
+    else if (FAIL_PARTITION == mode)
+        sv->partitioned = 0;
+}
+
+static void __bench(int mode, int n_servers, char* drop_rate, int trials,
+                    int election_timeout)
+{
+    char servers[16];
+    int i, timeouts = 0;
+
+    snprintf(servers, sizeof(servers), "%d", n_servers);
+    char* argv[] = {
+        "bench_election", "--servers", servers, "--drop_rate", drop_rate,
+        "--quiet", NULL
+    };
+
+    __sim_init(len(argv) - 1, argv);
+    for (i = 0; i < sys.n_servers; i++)
+        raft_set_election_timeout(sys.servers[i].raft, election_timeout);
+
+    histogram_t* time_ms = histogram_new();
+    histogram_t* msgs = histogram_new();
+
+    for (i = 0; i < trials; i++)
+    {
+        server_t* leader = __wait_for_leader(&sys, NULL, mode);
+        if (!leader)
+        {
+            timeouts += 1;
+            continue;
+        }
+
+        int iters = sys.iters;
+        int n_msgs = sys.n_msgs;
+
+        __fail(leader, mode);
+        if (__wait_for_leader(&sys, leader, mode))
+        {
+            histogram_record(time_ms, (sys.iters - iters) * MSEC_PER_ITER);
+            histogram_record(msgs, sys.n_msgs - n_msgs);
+        }
+        else
+            timeouts += 1;
+        __restore(leader, mode);
+    }
+
+    printf("%s\t%d\t%s\t%ld\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%d\n",
+           __fail_names[mode],
+           n_servers,
+           drop_rate,
+           time_ms->count,
+           timeouts,
+           histogram_percentile(time_ms, 50),
+           histogram_percentile(time_ms, 90),
+           histogram_percentile(time_ms, 99),
+           time_ms->max,
+           histogram_percentile(msgs, 50),
+           histogram_percentile(msgs, 99),
+           msgs->max);
+    fflush(stdout);
+
+    histogram_free(time_ms);
+    histogram_free(msgs);
+    __free_system(&sys);
+}
+
+int main(int argc, char **argv)
+{
+    int mode, i, j;
+    int trials = 1 < argc ? atoi(argv[1]) : 200;
+    int election_timeout = 2 < argc ? atoi(argv[2]) : 500;
+
+    printf("mode\tservers\tdrop_rate\ttrials\ttimeouts\t"
+           "time_p50_ms\ttime_p90_ms\ttime_p99_ms\ttime_max_ms\t"
+           "msgs_p50\tmsgs_p99\tmsgs_max\n");
+    for (mode = FAIL_KILL; mode <= FAIL_TRANSFER; mode++)
+        for (i = 0; i < (int)len(__sizes); i++)
+            for (j = 0; j < (int)len(__drop_rates); j++)
+                __bench(mode, __sizes[i], __drop_rates[j], trials,
+                        election_timeout);
+
+    return 0;
+}
@@ -0,0 +1,165 @@
+/**
+ * Throughput of applying commands to the state machines.
+ *
+ * Usage: bench_fsm [MAX_BATCH [CELLS]]
+ *
+ * For batches of 1K, 10K, ... up to MAX_BATCH commands (default 1M), applies
+ * the same random commands to CELLS cells (default 1000) three ways: one at a
+ * time with fsm_simple_push(), as a structure of arrays with
+ * fsm_simple_push_batch(), and through fsm_simple_ops.push_batch() as the
+ * simulator does. Reports commands per second for each, and checks that all
+ * three leave the same cells.
+ *
+ * Then compares the state machines --fsm picks from, pushing commands on
+ * CELLS keys one at a time, as servers apply entries.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "fsm.h"
+
+/* commands applied per measurement, in as many batches as that takes */
+#define CMDS_PER_RUN 10000000
+
+/* commands pushed to each state machine; they're made beforehand, so this
+ * many are held at once */
+#define FSM_CMDS 200000
+
+/* value size of the kvstore's commands, as --value_size defaults to */
+#define FSM_VALUE_SIZE 64
+
+static double __now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void __apply_push(fsm_simple_t* fsm, fsm_simple_cmd_t* cmds, int n)
+{
+    int i;
+    for (i = 0; i < n; i++)
+        fsm_simple_push(fsm, &cmds[i]);
+}
+
+static int __bench(int n, int n_cells)
+{
+    fsm_simple_t* push = fsm_simple_new(n_cells);
+    fsm_simple_t* batched = fsm_simple_new(n_cells);
+    fsm_simple_t* ops = fsm_simple_new(n_cells);
+    fsm_simple_batch_t* batch = fsm_simple_batch_new(n);
+    fsm_simple_cmd_t* cmds = malloc(n * sizeof(*cmds));
+    void** ptrs = malloc(n * sizeof(*ptrs));
+    int runs = CMDS_PER_RUN / n < 1 ? 1 : CMDS_PER_RUN / n;
+    double push_ns = 0, batch_ns = 0, ops_ns = 0, start;
+    int i, r, ret = 0;
+
+    for (i = 0; i < n; i++)
+        ptrs[i] = &cmds[i];
+
+    /* new commands every run, so that the branch predictor can't learn
+     * them */
+    for (r = 0; r < runs; r++)
+    {
+        batch->n = 0;
+        for (i = 0; i < n; i++)
+        {
+            fsm_simple_rand_cmd(push, &cmds[i]);
+            fsm_simple_batch_add(batch, &cmds[i]);
+        }
+
+        start = __now_ns();
+        __apply_push(push, cmds, n);
+        push_ns += __now_ns() - start;
+
+        start = __now_ns();
+        fsm_simple_push_batch(batched, batch);
+        batch_ns += __now_ns() - start;
+
+        start = __now_ns();
+        fsm_simple_ops.push_batch(ops, ptrs, n);
+        ops_ns += __now_ns() - start;
+    }
+
+    double cmds_applied = (double)n * runs;
+    printf("%d\t%d\t%.0f\t%.0f\t%.0f\t%.2f\n",
+           n_cells, n,
+           cmds_applied / (push_ns / 1e9),
+           cmds_applied / (batch_ns / 1e9),
+           cmds_applied / (ops_ns / 1e9),
+           push_ns / batch_ns);
+    fflush(stdout);
+
+    if (0 != fsm_simple_cmp(push, batched) || 0 != fsm_simple_cmp(push, ops) ||
+        fsm_simple_digest(push) != fsm_simple_digest(batched) ||
+        fsm_simple_digest(push) != fsm_simple_digest(ops))
+    {
+        fprintf(stderr, "batch of %d left different cells\n", n);
+        ret = -1;
+    }
+
+    free(ptrs);
+    free(cmds);
+    fsm_simple_batch_free(batch);
+    fsm_simple_free(ops);
+    fsm_simple_free(batched);
+    fsm_simple_free(push);
+    return ret;
+}
+
+static void __bench_fsm(fsm_ops_t* ops, int n_keys)
+{
+    fsm_config_t config = {
+        .key_space = n_keys,
+        .value_size = FSM_VALUE_SIZE,
+        .value_dist = FSM_VALUE_FIXED,
+    };
+    fsm_t fsm = ops->new(&config);
+    void** cmds = malloc(FSM_CMDS * sizeof(*cmds));
+    int i;
+
+    for (i = 0; i < FSM_CMDS; i++)
+        cmds[i] = ops->cmd(fsm, random() % n_keys);
+
+    double start = __now_ns();
+    for (i = 0; i < FSM_CMDS; i++)
+        ops->push(fsm, cmds[i]);
+    double ns = __now_ns() - start;
+
+    printf("%s\t%d\t%.0f\n", ops->name, n_keys, FSM_CMDS / (ns / 1e9));
+    fflush(stdout);
+
+    for (i = 0; i < FSM_CMDS; i++)
+        free(cmds[i]);
+    free(cmds);
+    ops->free(fsm);
+}
+
+int main(int argc, char **argv)
+{
+    int max_batch = 1 < argc ? atoi(argv[1]) : 1000000;
+    int n_cells = 2 < argc ? atoi(argv[2]) : 1000;
+    int n;
+
+    if (max_batch < 1 || n_cells < 1)
+    {
+        fprintf(stderr, "Usage: bench_fsm [MAX_BATCH [CELLS]]\n");
+        return -1;
+    }
+
+    srandom(1);
+    printf("cells\tbatch\tpush_per_sec\tbatch_per_sec\tops_per_sec\tspeedup\n");
+    for (n = 1000; n <= max_batch; n *= 10)
+        if (0 != __bench(n, n_cells))
+            return -1;
+
+    printf("\nfsm\tkeys\tpush_per_sec\n");
+    __bench_fsm(&fsm_simple_ops, n_cells);
+    __bench_fsm(&fsm_kvstore_ops, n_cells);
+    __bench_fsm(&fsm_heavy_ops, n_cells);
+
+    return 0;
+}
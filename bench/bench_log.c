@@ -0,0 +1,144 @@
+/**
+ * Microbenchmarks for the raft log ring buffer (deps/raft/raft_log.c).
+ *
+ * Usage: bench_log [MAX_ENTRIES]
+ *
+ * Runs each operation against logs of 1K, 10K, ... up to MAX_ENTRIES entries
+ * (default 100M; ~3.2GB of entries plus a transient copy when the ring
+ * grows, so pass something smaller on small machines).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <malloc.h>
+
+#include "raft.h"
+#include "raft_log.h"
+
+#define DELETE_BATCH 64
+
+static unsigned long __rand_state = 88172645463325252UL;
+
+/* xorshift, so the generator doesn't dominate lookups */
+static unsigned long __rand()
+{
+    __rand_state ^= __rand_state << 13;
+    __rand_state ^= __rand_state >> 7;
+    __rand_state ^= __rand_state << 17;
+    return __rand_state;
+}
+
+static double __now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static size_t __heap_used()
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    struct mallinfo2 mi = mallinfo2();
+    return mi.uordblks + mi.hblkhd;
+#else
+    return 0;
+#endif
+}
+
+static void __report(int size, const char* op, double ns, long ops, double bytes)
+{
+    printf("%d\t%s\t%.2f\t%.1f\n", size, op, ns / ops, bytes);
+}
+
+/* keep lookups from being optimised away */
+static volatile unsigned long __sink;
+
+static int __bench(int size)
+{
+    raft_entry_t ety;
+    void* polled;
+    long i;
+    double start;
+
+    memset(&ety, 0, sizeof(ety));
+
+    size_t heap_before = __heap_used();
+    log_t* l = log_new();
+    if (!l)
+        return -1;
+
+    start = __now_ns();
+    for (i = 0; i < size; i++)
+    {
+        ety.id = i;
+        ety.term = 1;
+        if (0 != log_append_entry(l, &ety))
+        {
+            fprintf(stderr, "out of memory at %ld entries\n", i);
+            log_free(l);
+            return -1;
+        }
+    }
+    double append_ns = __now_ns() - start;
+    double bytes = (double)(__heap_used() - heap_before) / size;
+    __report(size, "log_append_entry", append_ns, size, bytes);
+
+    start = __now_ns();
+    for (i = 0; i < size; i++)
+        __sink += log_get_at_idx(l, 1 + __rand() % size)->id;
+    __report(size, "log_get_at_idx", __now_ns() - start, size, bytes);
+
+    start = __now_ns();
+    for (i = 0; i < size; i++)
+    {
+        int n_etys;
+        __sink += log_get_from_idx(l, 1 + __rand() % size, &n_etys)->id + n_etys;
+    }
+    __report(size, "log_get_from_idx", __now_ns() - start, size, bytes);
+
+    /* delete the newer half, a batch at a time, like a follower truncating
+     * a conflicting suffix */
+    int deleted = 0;
+    start = __now_ns();
+    while (size / 2 < log_count(l))
+    {
+        int count = log_count(l);
+        int n = count - size / 2 < DELETE_BATCH ? count - size / 2 : DELETE_BATCH;
+        log_delete(l, log_get_current_idx(l) - n + 1);
+        deleted += n;
+    }
+    if (deleted)
+        __report(size, "log_delete", __now_ns() - start, deleted, bytes);
+
+    /* compact the older half */
+    int polled_count = 0;
+    start = __now_ns();
+    while (0 < log_count(l))
+    {
+        log_poll(l, &polled);
+        polled_count++;
+    }
+    if (polled_count)
+        __report(size, "log_poll", __now_ns() - start, polled_count, bytes);
+
+    log_free(l);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    long size, max_size = 100000000;
+
+    if (1 < argc)
+        max_size = atol(argv[1]);
+
+    printf("entries\top\tns_per_op\tbytes_per_entry\n");
+
+    for (size = 1000; size <= max_size; size *= 10)
+        if (0 != __bench(size))
+            return -1;
+
+    return 0;
+}
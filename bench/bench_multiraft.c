@@ -0,0 +1,58 @@
+/**
+ * Multi-raft transport overhead: the cost of many idle raft groups per server.
+ *
+ * Usage: bench_multiraft [ITERS [SERVERS]]
+ *
+ * For each number of groups builds a static cluster of SERVERS servers
+ * (default 3) where every server runs every group, and runs ITERS iterations
+ * (default 2000) without client traffic, with and without coalescing. Reports
+ * packets and raft messages per virtual second, how many of the extra groups
+ * agree on a leader at the end, and the wall clock time spent per virtual second.
+ */
+
+#include "bench_sim.h"
+
+static int __groups[] = { 1, 10, 100, 1000 };
+
+static void __bench(char* servers, int n_groups, int coalesce, int iters)
+{
+    char groups[16];
+
+    snprintf(groups, sizeof(groups), "%d", n_groups);
+    char* argv[] = {
+        "bench_multiraft", "--servers", servers, "--groups", groups,
+        "--client_rate", "0", "--quiet", "--coalesce", NULL
+    };
+    /* leave off --coalesce unless wanted */
+    int argc = len(argv) - 1 - !coalesce;
+
+    __sim_init(argc, argv);
+    double wall_ms_per_vsec = __sim_run(iters);
+    double virtual_sec = __sim_vsec(iters);
+
+    printf("%d\t%s\t%.0f\t%.0f\t%d\t%.3f\n",
+           n_groups,
+           coalesce ? "yes" : "no",
+           sys.n_packets / virtual_sec,
+           sys.n_msgs / virtual_sec,
+           __groups_with_leader(&sys),
+           wall_ms_per_vsec);
+    fflush(stdout);
+
+    __free_system(&sys);
+}
+
+int main(int argc, char **argv)
+{
+    int i, iters = 1 < argc ? atoi(argv[1]) : 2000;
+    char* servers = 2 < argc ? argv[2] : "3";
+
+    printf("groups\tcoalesce\tpackets_per_vsec\tmsgs_per_vsec\textra_groups_with_leader\twall_ms_per_vsec\n");
+    for (i = 0; i < (int)len(__groups); i++)
+    {
+        __bench(servers, __groups[i], 0, iters);
+        __bench(servers, __groups[i], 1, iters);
+    }
+
+    return 0;
+}
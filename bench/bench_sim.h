@@ -0,0 +1,58 @@
+/**
+ * Harness shared by the benchmarks that drive the simulator in process.
+ *
+ * Includes src/main.c in whole, so that the simulator's overheads are
+ * measured too and its functions and globals can be used directly.
+ */
+
+#ifndef BENCH_SIM_H
+#define BENCH_SIM_H
+
+#include <time.h>
+
+#define main virtraft_main
+#include "../src/main.c"
+#undef main
+
+static inline double __now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/**
+ * Set up sys from options, as virtraft does from its command line. Raft
+ * logging is off. The caller frees it with __free_system().
+ * @param argv Options, starting with the benchmark's name */
+static inline void __sim_init(int argc, char** argv)
+{
+    raft_funcs.log_event = NULL;
+
+    memset(&sys, 0, sizeof(sys));
+    memset(&opts, 0, sizeof(opts));
+    if (-1 == parse_options(argc, argv, &opts))
+        exit(-1);
+    __init_system(&sys);
+}
+
+/** @return virtual seconds that iters iterations take */
+static inline double __sim_vsec(int iters)
+{
+    return (double)iters * MSEC_PER_ITER / 1000;
+}
+
+/**
+ * Run sys for iters iterations
+ * @return wall clock msec spent per virtual second */
+static inline double __sim_run(int iters)
+{
+    int i;
+
+    double start = __now_ms();
+    for (i = 0; i < iters; i++)
+        __periodic(&sys);
+    return (__now_ms() - start) / __sim_vsec(iters);
+}
+
+#endif /* BENCH_SIM_H */
@@ -9,7 +9,7 @@ typedef struct
 } farraylist_t;
 
 
-farraylist_t *farraylist_new();
+farraylist_t *farraylist_new(unsigned int initial_capacity);
 
 /**
  * Insert item at index */
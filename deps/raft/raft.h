@@ -14,6 +14,10 @@
 #define RAFT_ERR_ONE_VOTING_CHANGE_ONLY      -3
 #define RAFT_ERR_SHUTDOWN                    -4
 #define RAFT_ERR_NOMEM                       -5
+#define RAFT_ERR_LEADER_TRANSFER_IN_PROGRESS -6
+#define RAFT_ERR_NOT_FOLLOWER                -7
+#define RAFT_ERR_STALE_SNAPSHOT              -8
+#define RAFT_ERR_INVALID_TRANSFER_TARGET     -9
 #define RAFT_ERR_LAST                        -100
 
 #define RAFT_REQUESTVOTE_ERR_GRANTED          1
@@ -27,15 +31,73 @@ typedef enum {
     RAFT_STATE_LEADER
 } raft_state_e;
 
+typedef enum {
+    /** Nothing is logged */
+    RAFT_LOG_NONE,
+    /** State changes, ie. elections and becoming leader/candidate/follower */
+    RAFT_LOG_INFO,
+    /** Every message sent, received and applied */
+    RAFT_LOG_DEBUG,
+} raft_log_level_e;
+
+/** Logs above this level are compiled out.
+ * eg. -DRAFT_LOG_LEVEL_MAX=RAFT_LOG_NONE removes all logging */
+#ifndef RAFT_LOG_LEVEL_MAX
+#define RAFT_LOG_LEVEL_MAX RAFT_LOG_DEBUG
+#endif
+
+/** Maximum number of arguments a log event carries */
+#define RAFT_LOG_MAX_ARGS 8
+
+typedef union
+{
+    int i;
+    const char* s;
+} raft_log_arg_t;
+
+/** Unformatted log message.
+ * Formatting is deferred to whoever consumes the event, see
+ * raft_log_event_format(). */
+typedef struct
+{
+    /** level of type raft_log_level_e */
+    int level;
+
+    /** printf style format string with static storage.
+     * Only %d and %s conversions are used. */
+    const char* fmt;
+
+    /** number of arguments in args */
+    int n_args;
+
+    /** arguments for each conversion in fmt, in order */
+    raft_log_arg_t args[RAFT_LOG_MAX_ARGS];
+} raft_log_event_t;
+
 typedef enum {
     RAFT_LOGTYPE_NORMAL,
     RAFT_LOGTYPE_ADD_NONVOTING_NODE,
     RAFT_LOGTYPE_ADD_NODE,
     RAFT_LOGTYPE_DEMOTE_NODE,
     RAFT_LOGTYPE_REMOVE_NODE,
+    /* votes in the new configuration of a joint change (C_old,new) */
+    RAFT_LOGTYPE_JOINT_ADD_NODE,
+    /* stops voting in the new configuration of a joint change */
+    RAFT_LOGTYPE_JOINT_DEMOTE_NODE,
+    /* switches to the new configuration (C_new), appended by the leader */
+    RAFT_LOGTYPE_LEAVE_JOINT,
     RAFT_LOGTYPE_NUM,
 } raft_logtype_e;
 
+/** How the leader replicates to a node */
+typedef enum {
+    /** looking for the last entry the node's log has in common with ours;
+     * appendentries carry no entries until it's found */
+    RAFT_NODE_PROGRESS_PROBE,
+    /** the logs match, entries are sent as soon as the node responds */
+    RAFT_NODE_PROGRESS_REPLICATE,
+} raft_node_progress_e;
+
 typedef struct
 {
     void *buf;
@@ -93,6 +155,10 @@ typedef struct
 
     /** term of candidate's last log entry */
     int last_log_term;
+
+    /** true if the election was started by a TimeoutNow message; the leader
+     * is handing over, so voters shouldn't stick to it */
+    int transfer_leader;
 } msg_requestvote_t;
 
 /** Vote request response message.
@@ -106,6 +172,48 @@ typedef struct
     int vote_granted;
 } msg_requestvote_response_t;
 
+/** Pre-vote request message.
+ * Sent to nodes before a server becomes a candidate, to find out if it could
+ * win an election. Unlike a vote request, receiving it changes nothing, so a
+ * server that can't win (eg. it was partitioned) doesn't disrupt the cluster
+ * by incrementing its term. See Raft dissertation §9.6. */
+typedef struct
+{
+    /** the term the server would be a candidate in (ie. currentTerm + 1) */
+    int term;
+
+    /** server requesting pre-vote */
+    int candidate_id;
+
+    /** index of server's last log entry */
+    int last_log_idx;
+
+    /** term of server's last log entry */
+    int last_log_term;
+} msg_prevote_t;
+
+/** Pre-vote request response message. */
+typedef struct
+{
+    /** currentTerm, for the server to update itself */
+    int term;
+
+    /** the term of the pre-vote request this is a response to */
+    int prevote_term;
+
+    /** true means the server would receive a vote */
+    int vote_granted;
+} msg_prevote_response_t;
+
+/** TimeoutNow message.
+ * Sent by a leader transferring leadership to a caught up node, which starts
+ * an election immediately. See raft_transfer_leader(). */
+typedef struct
+{
+    /** leader's currentTerm */
+    int term;
+} msg_timeoutnow_t;
+
 /** Appendentries message.
  * This message is used to tell nodes if it's safe to apply entries to the FSM.
  * Can be sent without any entries as a keep alive message.
@@ -132,6 +240,12 @@ typedef struct
 
     /** array of entries within this message */
     msg_entry_t* entries;
+
+    /* Non-Raft fields follow: */
+
+    /** identifies the leader's heartbeat round, echoed back in the response.
+     * Used to confirm leadership for read requests */
+    int msg_id;
 } msg_appendentries_t;
 
 /** Appendentries response message.
@@ -155,6 +269,9 @@ typedef struct
 
     /** The first idx that we received within the appendentries message */
     int first_idx;
+
+    /** msg_id of the appendentries message this is a response to */
+    int msg_id;
 } msg_appendentries_response_t;
 
 typedef void* raft_server_t;
@@ -175,6 +292,36 @@ typedef int (
     msg_requestvote_t* msg
     );
 
+/** Callback for sending pre-vote request messages.
+ * @param[in] raft The Raft server making this callback
+ * @param[in] user_data User data that is passed from Raft server
+ * @param[in] node The node's ID that we are sending this message to
+ * @param[in] msg The pre-vote request message to be sent
+ * @return 0 on success */
+typedef int (
+*func_send_prevote_f
+)   (
+    raft_server_t* raft,
+    void *user_data,
+    raft_node_t* node,
+    msg_prevote_t* msg
+    );
+
+/** Callback for sending TimeoutNow messages.
+ * @param[in] raft The Raft server making this callback
+ * @param[in] user_data User data that is passed from Raft server
+ * @param[in] node The node's ID that we are sending this message to
+ * @param[in] msg The TimeoutNow message to be sent
+ * @return 0 on success */
+typedef int (
+*func_send_timeoutnow_f
+)   (
+    raft_server_t* raft,
+    void *user_data,
+    raft_node_t* node,
+    msg_timeoutnow_t* msg
+    );
+
 /** Callback for sending append entries messages.
  * @param[in] raft The Raft server making this callback
  * @param[in] user_data User data that is passed from Raft server
@@ -190,6 +337,40 @@ typedef int (
     msg_appendentries_t* msg
     );
 
+/** Callback for sending a snapshot to a node.
+ * The node needs entries that were compacted out of the log, see
+ * raft_end_snapshot(). Transferring the snapshot is up to the user; the
+ * receiving server installs it with raft_begin_load_snapshot().
+ * @param[in] raft The Raft server making this callback
+ * @param[in] user_data User data that is passed from Raft server
+ * @param[in] node The node that needs the snapshot
+ * @return 0 on success */
+typedef int (
+*func_send_snapshot_f
+)   (
+    raft_server_t* raft,
+    void *user_data,
+    raft_node_t* node
+    );
+
+/** Callback for completing a read request.
+ * @param[in] raft The Raft server making this callback
+ * @param[in] user_data User data that is passed from Raft server
+ * @param[in] read_udata The user data passed to raft_read_request()
+ * @param[in] status
+ *  0 when the read is safe, ie. the FSM has applied every entry committed
+ *  before the read was requested;
+ *  RAFT_ERR_NOT_LEADER if leadership was lost and the read should be retried
+ *  on the new leader */
+typedef void (
+*func_read_response_f
+)   (
+    raft_server_t* raft,
+    void *user_data,
+    void *read_udata,
+    int status
+    );
+
 /** Callback for detecting when non-voting nodes have obtained enough logs.
  * This triggers only when there are no pending configuration changes.
  * @param[in] raft The Raft server making this callback
@@ -222,6 +403,23 @@ typedef void (
     );
 #endif
 
+/** Callback for receiving unformatted log events.
+ * This is cheaper than func_log_f because nothing is formatted; the event
+ * can be stored and formatted later using raft_log_event_format().
+ * This callback is optional
+ * @param[in] raft The Raft server making this callback
+ * @param[in] node The node that is the subject of this log. Could be NULL.
+ * @param[in] user_data User data that is passed from Raft server
+ * @param[in] ev The event. Only valid for the duration of the callback */
+typedef void (
+*func_log_event_f
+)    (
+    raft_server_t* raft,
+    raft_node_t* node,
+    void *user_data,
+    const raft_log_event_t* ev
+    );
+
 /** Callback for saving who we voted for to disk.
  * For safety reasons this callback MUST flush the change to disk.
  * @param[in] raft The Raft server making this callback
@@ -290,6 +488,23 @@ typedef struct
     /** Callback for sending appendentries messages */
     func_send_appendentries_f send_appendentries;
 
+    /** Callback for sending pre-vote request messages.
+     * If set, a server only becomes a candidate once a majority has granted
+     * it a pre-vote.
+     * This callback is optional */
+    func_send_prevote_f send_prevote;
+
+    /** Callback for sending TimeoutNow messages.
+     * Required if raft_transfer_leader() is used */
+    func_send_timeoutnow_f send_timeoutnow;
+
+    /** Callback for sending a snapshot to a node that rejected an
+     * appendentries because it's missing compacted entries. It's called
+     * again if the node keeps rejecting them, eg. while the transfer is still
+     * in progress.
+     * Required if raft_end_snapshot() is used */
+    func_send_snapshot_f send_snapshot;
+
     /** Callback for finite state machine application
      * Return 0 on success.
      * Return RAFT_ERR_SHUTDOWN if you want the server to shutdown. */
@@ -330,9 +545,18 @@ typedef struct
     /** Callback for detecting when a non-voting node has sufficient logs. */
     func_node_has_sufficient_logs_f node_has_sufficient_logs;
 
+    /** Callback for completing read requests, see raft_read_request().
+     * Required if raft_read_request() is used */
+    func_read_response_f read_response;
+
     /** Callback for catching debugging log messages
      * This callback is optional */
     func_log_f log;
+
+    /** Callback for catching unformatted debugging log events.
+     * If set, this is used instead of log.
+     * This callback is optional */
+    func_log_event_f log_event;
 } raft_cbs_t;
 
 typedef struct
@@ -405,6 +629,40 @@ void raft_remove_node(raft_server_t* me_, raft_node_t* node);
  * @param[in] msec Election timeout in milliseconds */
 void raft_set_election_timeout(raft_server_t* me, int msec);
 
+/** Set the most verbose level that is logged.
+ * Defaults to RAFT_LOG_DEBUG. Nothing is logged if neither the log nor the
+ * log_event callback is set.
+ * @param[in] level Level of type raft_log_level_e */
+void raft_set_log_level(raft_server_t* me, int level);
+
+/** Serve reads from a leader lease instead of a heartbeat round.
+ * A leader holds a lease for the election timeout after sending a heartbeat
+ * round that a majority acknowledged, because until then those servers won't
+ * vote for another candidate (Raft dissertation §6.4.1). Reads requested
+ * within the lease complete without waiting for another round. A leader
+ * that sent a TimeoutNow holds no lease for the rest of that term, as the
+ * target may still be elected after the transfer timed out.
+ * Disabled by default.
+ * @param[in] max_drift Bound on the clock rate difference between servers in
+ *  percent; the lease is shortened by this much. -1 disables lease reads */
+void raft_set_lease_reads(raft_server_t* me, int max_drift);
+
+/** Make the leader step down if a majority of voting nodes hasn't responded
+ * to its appendentries within an election timeout.
+ * This bounds how long a partitioned leader keeps accepting entries that
+ * can't commit. Disabled by default.
+ * @param[in] enabled 1 to enable, 0 to disable */
+void raft_set_check_quorum(raft_server_t* me, int enabled);
+
+/** Limit how fast the leader sends entries to non-voting nodes.
+ * Catching up a new node otherwise streams the whole log as fast as it
+ * responds, competing with the voting nodes. The budget is shared by all
+ * non-voting nodes, and at most a second's worth is saved up. An entry
+ * bigger than that is still sent once the budget is full, leaving it in
+ * debt. Unlimited by default.
+ * @param[in] bytes_per_sec Bytes of entry data per second, 0 for unlimited */
+void raft_set_learner_bandwidth(raft_server_t* me, int bytes_per_sec);
+
 /** Set request timeout in milliseconds.
  * The amount of time before we resend an appendentries message
  * @param[in] msec Request timeout in milliseconds */
@@ -471,6 +729,50 @@ int raft_recv_requestvote_response(raft_server_t* me,
                                    raft_node_t* node,
                                    msg_requestvote_response_t* r);
 
+/** Receive a pre-vote request message.
+ * Doesn't change the receiving server's term, vote or timeout.
+ * @param[in] node The node who sent us this message
+ * @param[in] pv The pre-vote request message
+ * @param[out] r The resulting response
+ * @return 0 on success */
+int raft_recv_prevote(raft_server_t* me,
+                      raft_node_t* node,
+                      msg_prevote_t* pv,
+                      msg_prevote_response_t *r);
+
+/** Receive a response from a pre-vote request message we sent.
+ * Becomes a candidate once a majority granted a pre-vote.
+ * @param[in] node The node this response was sent by
+ * @param[in] r The pre-vote response message
+ * @return 0 on success */
+int raft_recv_prevote_response(raft_server_t* me,
+                               raft_node_t* node,
+                               msg_prevote_response_t* r);
+
+/** Receive a TimeoutNow message.
+ * Starts an election straight away, skipping pre-vote.
+ * @param[in] node The node who sent us this message
+ * @param[in] msg The TimeoutNow message
+ * @return 0 on success */
+int raft_recv_timeoutnow(raft_server_t* me,
+                         raft_node_t* node,
+                         msg_timeoutnow_t* msg);
+
+/** Hand leadership over to another node (Raft dissertation §3.10).
+ *
+ * The leader stops accepting entries, brings the target's log up to date,
+ * then sends it a TimeoutNow message so that it starts an election. The
+ * transfer is abandoned if it hasn't completed within an election timeout.
+ *
+ * @param[in] node_id The voting node to become the leader
+ * @return
+ *  0 on success;
+ *  RAFT_ERR_INVALID_TRANSFER_TARGET the target is unknown, won't be voting,
+ *  or is this server;
+ *  RAFT_ERR_NOT_LEADER server is not the leader;
+ *  RAFT_ERR_LEADER_TRANSFER_IN_PROGRESS a transfer is in progress */
+int raft_transfer_leader(raft_server_t* me, int node_id);
+
 /** Receive an entry message from the client.
  *
  * Append the entry to the log and send appendentries to followers.
@@ -499,12 +801,115 @@ int raft_recv_requestvote_response(raft_server_t* me,
  *  RAFT_ERR_NOT_LEADER server is not the leader;
  *  RAFT_ERR_SHUTDOWN server should be shutdown;
  *  RAFT_ERR_ONE_VOTING_CHANGE_ONLY there is a non-voting change inflight;
+ *  RAFT_ERR_LEADER_TRANSFER_IN_PROGRESS leadership is being transferred;
  *  RAFT_ERR_NOMEM memory allocation failure
  */
 int raft_recv_entry(raft_server_t* me,
                     msg_entry_t* ety,
                     msg_entry_response_t *r);
 
+/** Receive several entry messages from the client at once.
+ *
+ * Like raft_recv_entry(), but the entries are appended in order and each
+ * follower is sent a single appendentries for the whole batch.
+ *
+ * Several nodes can be added and demoted in one joint configuration change
+ * (Raft dissertation §4.3) by batching RAFT_LOGTYPE_JOINT_ADD_NODE and
+ * RAFT_LOGTYPE_JOINT_DEMOTE_NODE entries. Until the leader's
+ * RAFT_LOGTYPE_LEAVE_JOINT entry is applied, elections and commits need a
+ * majority of both the old and the new configuration.
+ *
+ * If appending fails part way, the entries before the failing one stay
+ * appended and are replicated.
+ *
+ * @param[in] entries The entry messages
+ * @param[in] n_entries Number of entries
+ * @param[out] r The resulting responses, one per entry
+ * @return
+ *  0 on success;
+ *  RAFT_ERR_NOT_LEADER server is not the leader;
+ *  RAFT_ERR_SHUTDOWN server should be shutdown;
+ *  RAFT_ERR_ONE_VOTING_CHANGE_ONLY there is a voting change inflight, or the
+ *   batch has more than one that isn't part of a joint change;
+ *  RAFT_ERR_LEADER_TRANSFER_IN_PROGRESS leadership is being transferred;
+ *  RAFT_ERR_NOMEM memory allocation failure
+ */
+int raft_recv_entries(raft_server_t* me,
+                      msg_entry_t* entries,
+                      int n_entries,
+                      msg_entry_response_t *r);
+
+/** Request a linearizable read without appending to the log (ie. ReadIndex,
+ * Raft dissertation §6.4).
+ *
+ * If lease reads are enabled and the leader holds a lease, the heartbeat
+ * round is skipped. See raft_set_lease_reads().
+ *
+ * The read_response callback is called once a majority has acknowledged a
+ * heartbeat sent after this request, the leader has committed an entry in its
+ * term, and everything committed when the request was made has been applied.
+ * The read can then be served from the FSM.
+ *
+ * Reads made before the next heartbeat round share it. The round is sent on
+ * the next raft_periodic() call.
+ *
+ * @param[in] read_udata Passed to the read_response callback
+ * @return
+ *  0 on success;
+ *  RAFT_ERR_NOT_LEADER server is not the leader;
+ *  RAFT_ERR_NOMEM memory allocation failure */
+int raft_read_request(raft_server_t* me, void* read_udata);
+
+/** Start a snapshot of the entries applied so far.
+ * The user snapshots its state machine, then calls raft_end_snapshot() once
+ * that's been saved. Appending and applying entries can carry on meanwhile.
+ *
+ * The snapshot's configuration is the current one, ie. that of the nodes
+ * from raft_get_node_from_idx() and their voting flags.
+ * @return
+ *  0 on success;
+ *  -1 if a snapshot is in progress, nothing was applied since the last one,
+ *   or a configuration change was appended but not applied yet, so that the
+ *   current configuration isn't the snapshot's */
+int raft_begin_snapshot(raft_server_t* me);
+
+/** Compact the log up to the snapshot started by raft_begin_snapshot().
+ * The log_poll callback is called for each entry removed. Nodes that need
+ * those entries are sent the snapshot instead, see send_snapshot.
+ * @return 0 on success; -1 if there isn't a snapshot in progress */
+int raft_end_snapshot(raft_server_t* me);
+
+/** Replace the log with a snapshot received from the leader.
+ * The log is discarded, as is any snapshot in progress, and every node except
+ * this server is removed. The
+ * user then adds the snapshot's configuration with raft_add_node(),
+ * raft_add_non_voting_node() and raft_node_set_voting_new(), installs its
+ * state machine, and calls raft_end_load_snapshot().
+ * The log_pop and log_poll callbacks are called for the entries discarded.
+ * Once the checks pass the log is replaced even if one of them fails, so the
+ * server is never left with part of its log.
+ * @param[in] last_idx Index of the last entry the snapshot includes
+ * @param[in] last_term Term of that entry
+ * @return 0 on success;
+ *  RAFT_ERR_NOT_FOLLOWER the server isn't a follower, so nothing changed;
+ *  RAFT_ERR_STALE_SNAPSHOT the snapshot doesn't add any committed entries,
+ *  so nothing changed;
+ *  otherwise the first error a callback returned, after the snapshot was
+ *  loaded */
+int raft_begin_load_snapshot(raft_server_t* me, int last_idx, int last_term);
+
+/** Finish installing a snapshot; voting nodes of its configuration are taken
+ * to have been added and caught up */
+void raft_end_load_snapshot(raft_server_t* me);
+
+/**
+ * @return index of the last entry compacted into a snapshot; 0 if none */
+int raft_get_snapshot_last_idx(raft_server_t* me);
+
+/**
+ * @return term of the last entry compacted into a snapshot; 0 if none */
+int raft_get_snapshot_last_term(raft_server_t* me);
+
 /**
  * @return server's node ID; -1 if it doesn't know what it is */
 int raft_get_nodeid(raft_server_t* me);
@@ -525,6 +930,15 @@ int raft_get_num_nodes(raft_server_t* me);
  * @return number of voting nodes that this server has */
 int raft_get_num_voting_nodes(raft_server_t* me_);
 
+/**
+ * @return 1 if a joint configuration change is in progress, ie. the old and
+ *  new configurations differ until RAFT_LOGTYPE_LEAVE_JOINT is applied */
+int raft_is_joint(raft_server_t* me_);
+
+/**
+ * @return 1 if a voting configuration change hasn't been applied yet */
+int raft_voting_change_is_in_progress(raft_server_t* me_);
+
 /**
  * @return number of items within log */
 int raft_get_log_count(raft_server_t* me);
@@ -553,6 +967,10 @@ int raft_is_leader(raft_server_t* me);
  * @return 1 if candidate; 0 otherwise */
 int raft_is_candidate(raft_server_t* me);
 
+/**
+ * @return 1 if collecting pre-votes; 0 otherwise */
+int raft_is_prevoting(raft_server_t* me);
+
 /**
  * @return currently elapsed timeout in milliseconds */
 int raft_get_timeout_elapsed(raft_server_t* me);
@@ -569,6 +987,10 @@ int raft_get_last_applied_idx(raft_server_t* me);
  * @return the node's next index */
 int raft_node_get_next_idx(raft_node_t* node);
 
+/**
+ * @return how the leader replicates to the node, of type raft_node_progress_e */
+int raft_node_get_progress(raft_node_t* node);
+
 /**
  * @return this node's user data */
 int raft_node_get_match_idx(raft_node_t* me);
@@ -601,6 +1023,16 @@ raft_node_t* raft_get_node_from_idx(raft_server_t* me_, const int idx);
  * @return number of votes this server has received this election */
 int raft_get_nvotes_for_me(raft_server_t* me);
 
+/**
+ * @return number of vote and pre-vote requests this server ignored because it
+ *  had heard from a leader within the election timeout */
+int raft_get_suppressed_votes(raft_server_t* me);
+
+/**
+ * @return number of times this server stepped down as leader because a
+ *  majority stopped responding. See raft_set_check_quorum() */
+int raft_get_quorum_step_downs(raft_server_t* me);
+
 /**
  * @return node ID of who I voted for */
 int raft_get_voted_for(raft_server_t* me);
@@ -673,13 +1105,24 @@ int raft_get_last_log_term(raft_server_t* me_);
 
 /** Turn a node into a voting node.
  * Voting nodes can take part in elections and in-regards to commiting entries,
- * are counted in majorities. */
+ * are counted in majorities. This sets both the current and the new
+ * configuration. */
 void raft_node_set_voting(raft_node_t* node, int voting);
 
 /** Tell if a node is a voting node or not.
+ * During a joint configuration change this is the old configuration.
  * @return 1 if this is a voting node. Otherwise 0. */
 int raft_node_is_voting(raft_node_t* me_);
 
+/** Stage a node as voting in the new configuration of a joint change.
+ * See RAFT_LOGTYPE_JOINT_ADD_NODE. */
+void raft_node_set_voting_new(raft_node_t* node, int voting);
+
+/** Tell if a node votes in the new configuration.
+ * Outside of a joint configuration change this is raft_node_is_voting().
+ * @return 1 if this is a voting node in the new configuration. */
+int raft_node_is_voting_new(raft_node_t* me_);
+
 /** Apply all entries up to the commit index
  * @return
  *  0 on success;
@@ -695,6 +1138,13 @@ void raft_become_leader(raft_server_t* me);
  * currentTerm. */
 void raft_become_follower(raft_server_t* me);
 
+/** Format a log event.
+ * @param[in] ev The event to format
+ * @param[out] buf Where the formatted message is written
+ * @param[in] len Size of buf
+ * @return number of characters written, not including the terminating 0 */
+int raft_log_event_format(const raft_log_event_t* ev, char* buf, int len);
+
 /** Determine if entry is voting configuration change.
  * @param[in] ety The entry to query.
  * @return 1 if this is a voting configuration change. */
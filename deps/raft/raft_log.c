@@ -125,7 +125,7 @@ int log_append_entry(log_t* me_, raft_entry_t* c)
     }
 
     me->count++;
-    me->back++;
+    me->back = (me->back + 1) % me->size;
 
     return e;
 }
@@ -137,7 +137,7 @@ raft_entry_t* log_get_from_idx(log_t* me_, int idx, int *n_etys)
 
     assert(0 <= idx - 1);
 
-    if (me->base + me->count < idx || idx < me->base)
+    if (me->base + me->count < idx || idx <= me->base)
     {
         *n_etys = 0;
         return NULL;
@@ -166,7 +166,7 @@ raft_entry_t* log_get_at_idx(log_t* me_, int idx)
 
     assert(0 <= idx - 1);
 
-    if (me->base + me->count < idx || idx < me->base)
+    if (me->base + me->count < idx || idx <= me->base)
         return NULL;
 
     /* idx starts at 1 */
@@ -194,14 +194,15 @@ int log_delete(log_t* me_, int idx)
     for (end = log_count(me_); idx < end; idx++)
     {
         int idx_tmp = me->base + me->count;
+        int back = (me->back + me->size - 1) % me->size;
         if (me->cb && me->cb->log_pop) {
             int e = me->cb->log_pop(me->raft, raft_get_udata(me->raft),
-                                    &me->entries[me->back - 1], idx_tmp);
+                                    &me->entries[back], idx_tmp);
             if (0 != e)
                 return e;
         }
-        raft_pop_log(me->raft, &me->entries[me->back - 1], idx_tmp);
-        me->back--;
+        raft_pop_log(me->raft, &me->entries[back], idx_tmp);
+        me->back = back;
         me->count--;
     }
     return 0;
@@ -222,7 +223,7 @@ int log_poll(log_t * me_, void** etyp)
         if (0 != e)
             return e;
     }
-    me->front++;
+    me->front = (me->front + 1) % me->size;
     me->count--;
     me->base++;
     *etyp = (void*)elem;
@@ -264,3 +265,16 @@ int log_get_current_idx(log_t* me_)
     log_private_t* me = (log_private_t*)me_;
     return log_count(me_) + me->base;
 }
+
+int log_get_base(log_t* me_)
+{
+    return ((log_private_t*)me_)->base;
+}
+
+void log_load_from_snapshot(log_t* me_, int idx)
+{
+    log_private_t* me = (log_private_t*)me_;
+
+    log_empty(me_);
+    me->base = idx;
+}
@@ -44,4 +44,12 @@ raft_entry_t *log_peektail(log_t * me_);
 
 int log_get_current_idx(log_t* me_);
 
+/**
+ * @return idx of the last entry compacted out of the log; 0 if none */
+int log_get_base(log_t* me_);
+
+/**
+ * Empty the log, so that the next entry appended is idx + 1 */
+void log_load_from_snapshot(log_t* me_, int idx);
+
 #endif /* RAFT_LOG_H_ */
@@ -19,6 +19,8 @@
 #define RAFT_NODE_VOTED_FOR_ME       1
 #define RAFT_NODE_VOTING             (1 << 1)
 #define RAFT_NODE_HAS_SUFFICIENT_LOG (1 << 2)
+#define RAFT_NODE_PREVOTED_FOR_ME    (1 << 3)
+#define RAFT_NODE_VOTING_NEW         (1 << 4)
 
 typedef struct
 {
@@ -30,6 +32,15 @@ typedef struct
     int flags;
 
     int id;
+
+    /* highest appendentries msg_id the node acknowledged this term */
+    int last_acked_msgid;
+
+    /* leader's clock when the node last responded to an appendentries */
+    long last_response;
+
+    /* of type raft_node_progress_e */
+    int progress;
 } raft_node_private_t;
 
 raft_node_t* raft_node_new(void* udata, int id)
@@ -42,7 +53,7 @@ raft_node_t* raft_node_new(void* udata, int id)
     me->next_idx = 1;
     me->match_idx = 0;
     me->id = id;
-    me->flags = RAFT_NODE_VOTING;
+    me->flags = RAFT_NODE_VOTING | RAFT_NODE_VOTING_NEW;
     return (raft_node_t*)me;
 }
 
@@ -103,13 +114,80 @@ int raft_node_has_vote_for_me(raft_node_t* me_)
     return (me->flags & RAFT_NODE_VOTED_FOR_ME) != 0;
 }
 
+void raft_node_prevote_for_me(raft_node_t* me_, const int vote)
+{
+    raft_node_private_t* me = (raft_node_private_t*)me_;
+    if (vote)
+        me->flags |= RAFT_NODE_PREVOTED_FOR_ME;
+    else
+        me->flags &= ~RAFT_NODE_PREVOTED_FOR_ME;
+}
+
+int raft_node_has_prevote_for_me(raft_node_t* me_)
+{
+    raft_node_private_t* me = (raft_node_private_t*)me_;
+    return (me->flags & RAFT_NODE_PREVOTED_FOR_ME) != 0;
+}
+
+void raft_node_set_last_acked_msgid(raft_node_t* me_, int msg_id)
+{
+    raft_node_private_t* me = (raft_node_private_t*)me_;
+    if (me->last_acked_msgid < msg_id)
+        me->last_acked_msgid = msg_id;
+}
+
+int raft_node_get_last_acked_msgid(raft_node_t* me_)
+{
+    raft_node_private_t* me = (raft_node_private_t*)me_;
+    return me->last_acked_msgid;
+}
+
+void raft_node_set_last_response(raft_node_t* me_, long now)
+{
+    raft_node_private_t* me = (raft_node_private_t*)me_;
+    me->last_response = now;
+}
+
+long raft_node_get_last_response(raft_node_t* me_)
+{
+    raft_node_private_t* me = (raft_node_private_t*)me_;
+    return me->last_response;
+}
+
+void raft_node_set_progress(raft_node_t* me_, int progress)
+{
+    raft_node_private_t* me = (raft_node_private_t*)me_;
+    me->progress = progress;
+}
+
+int raft_node_get_progress(raft_node_t* me_)
+{
+    raft_node_private_t* me = (raft_node_private_t*)me_;
+    return me->progress;
+}
+
 void raft_node_set_voting(raft_node_t* me_, int voting)
 {
     raft_node_private_t* me = (raft_node_private_t*)me_;
     if (voting)
-        me->flags |= RAFT_NODE_VOTING;
+        me->flags |= RAFT_NODE_VOTING | RAFT_NODE_VOTING_NEW;
     else
-        me->flags &= ~RAFT_NODE_VOTING;
+        me->flags &= ~(RAFT_NODE_VOTING | RAFT_NODE_VOTING_NEW);
+}
+
+void raft_node_set_voting_new(raft_node_t* me_, int voting)
+{
+    raft_node_private_t* me = (raft_node_private_t*)me_;
+    if (voting)
+        me->flags |= RAFT_NODE_VOTING_NEW;
+    else
+        me->flags &= ~RAFT_NODE_VOTING_NEW;
+}
+
+int raft_node_is_voting_new(raft_node_t* me_)
+{
+    raft_node_private_t* me = (raft_node_private_t*)me_;
+    return (me->flags & RAFT_NODE_VOTING_NEW) != 0;
 }
 
 int raft_node_is_voting(raft_node_t* me_)
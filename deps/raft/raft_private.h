@@ -17,6 +17,20 @@ enum {
  * @author Willem Thiart himself@willemthiart.com
  */
 
+/** Pending read request */
+typedef struct raft_read_request_s {
+    /* the commit idx when the read was requested, or -1 if the leader hadn't
+     * committed an entry in its term yet */
+    int read_idx;
+
+    /* heartbeat round that confirms we were still the leader */
+    int msg_id;
+
+    void* udata;
+
+    struct raft_read_request_s* next;
+} raft_read_request_t;
+
 typedef struct {
     /* Persistent state: */
 
@@ -69,10 +83,111 @@ typedef struct {
     /* our membership with the cluster is confirmed (ie. configuration log was
      * committed) */
     int connected;
+
+    /* we're a follower collecting pre-votes before becoming a candidate */
+    int prevoting;
+
+    /* number of vote and pre-vote requests ignored because we had recently
+     * heard from a leader */
+    int suppressed_votes;
+
+    /* id of the latest heartbeat round */
+    int msg_id;
+
+    /* read requests, oldest first */
+    raft_read_request_t* reads_head;
+    raft_read_request_t* reads_tail;
+
+    /* milliseconds passed to raft_periodic() so far; our clock */
+    long now;
+
+    /* lease reads' clock drift bound in percent, or -1 if disabled */
+    int lease_max_drift;
+
+    /* heartbeat round that will renew the lease when acknowledged, and when
+     * it was sent; 0 if none */
+    int lease_msg_id;
+    long lease_round_start;
+
+    /* time our leader lease runs out */
+    long lease_expiry;
+
+    /* node we're transferring leadership to, or NULL */
+    raft_node_t* transfer_target;
+
+    /* milliseconds since the transfer started */
+    int transfer_elapsed;
+
+    /* TimeoutNow was sent to transfer_target */
+    int transfer_timeoutnow_sent;
+
+    /* term we last sent a TimeoutNow in, or -1; one that arrives late can
+     * start an election after the transfer timed out, so we don't hold a
+     * lease again for the rest of that term */
+    int timeoutnow_term;
+
+    /* our candidacy was started by a TimeoutNow message */
+    int transfer_election;
+
+    /* step down as leader if a majority hasn't responded within an election
+     * timeout */
+    int check_quorum;
+
+    /* time of the last check_quorum check */
+    long quorum_checked_at;
+
+    /* number of times we stepped down because of check_quorum */
+    int quorum_step_downs;
+
+    /* bytes of entries per second sent to non-voting nodes, 0 if unlimited */
+    int learner_bandwidth;
+
+    /* what non-voting nodes can still be sent, in thousandths of a byte;
+     * negative while in debt */
+    long learner_budget;
+
+    /* last entry compacted out of the log, and its term; 0 if none */
+    int snapshot_last_idx;
+    int snapshot_last_term;
+
+    /* last entry the snapshot in progress includes, and its term; 0 if
+     * there isn't one in progress */
+    int snapshot_in_progress_idx;
+    int snapshot_in_progress_term;
+
+    /* most verbose level the user asked to be logged */
+    int log_level_wanted;
+
+    /* most verbose level that is logged; RAFT_LOG_NONE if there isn't a log
+     * callback */
+    int log_level;
 } raft_server_private_t;
 
+void raft_log_emit(raft_server_t* me_, int level, raft_node_t* node,
+                   const char *fmt, ...);
+
+/** Log a message.
+ * Disabled levels cost a single comparison, and their arguments aren't
+ * evaluated. */
+#define __log(me_, level, node, ...) \
+    do { \
+        if ((level) <= RAFT_LOG_LEVEL_MAX && \
+            (level) <= ((raft_server_private_t*)(me_))->log_level) \
+            raft_log_emit((me_), (level), (node), __VA_ARGS__); \
+    } while (0)
+
+void raft_update_log_level(raft_server_t* me_);
+
+/** Complete the read requests that are safe to serve */
+void raft_process_reads(raft_server_t* me_);
+
+/** Fail every pending read request with status */
+void raft_clear_reads(raft_server_t* me_, int status);
+
 int raft_election_start(raft_server_t* me);
 
+void raft_prevote_start(raft_server_t* me_);
+
 int raft_become_candidate(raft_server_t* me);
 
 void raft_randomize_election_timeout(raft_server_t* me_);
@@ -81,8 +196,14 @@ void raft_randomize_election_timeout(raft_server_t* me_);
  * @return 0 on error */
 int raft_send_requestvote(raft_server_t* me, raft_node_t* node);
 
+/**
+ * @return 0 on error */
+int raft_send_prevote(raft_server_t* me, raft_node_t* node);
+
 int raft_send_appendentries(raft_server_t* me, raft_node_t* node);
 
+int raft_send_timeoutnow(raft_server_t* me_, raft_node_t* node);
+
 int raft_send_appendentries_all(raft_server_t* me_);
 
 /**
@@ -116,6 +237,20 @@ void raft_node_vote_for_me(raft_node_t* me_, const int vote);
 
 int raft_node_has_vote_for_me(raft_node_t* me_);
 
+void raft_node_prevote_for_me(raft_node_t* me_, const int vote);
+
+int raft_node_has_prevote_for_me(raft_node_t* me_);
+
+void raft_node_set_last_acked_msgid(raft_node_t* me_, int msg_id);
+
+int raft_node_get_last_acked_msgid(raft_node_t* me_);
+
+void raft_node_set_last_response(raft_node_t* me_, long now);
+
+long raft_node_get_last_response(raft_node_t* me_);
+
+void raft_node_set_progress(raft_node_t* me_, int progress);
+
 void raft_node_set_has_sufficient_logs(raft_node_t* me_);
 
 int raft_node_has_sufficient_logs(raft_node_t* me_);
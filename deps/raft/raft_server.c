@@ -28,17 +28,110 @@
 #define max(a, b) ((a) < (b) ? (b) : (a))
 #endif
 
-static void __log(raft_server_t *me_, raft_node_t* node, const char *fmt, ...)
+/**
+ * @param[in] p Points to the '%' starting a conversion
+ * @return pointer to the conversion character */
+static const char* __conversion(const char* p)
+{
+    for (p++; *p && strchr("-+ #0123456789.", *p); p++)
+        ;
+    return p;
+}
+
+void raft_log_emit(raft_server_t* me_, int level, raft_node_t* node,
+                   const char *fmt, ...)
 {
     raft_server_private_t* me = (raft_server_private_t*)me_;
-    if (me->cb.log == NULL) return;
-    char buf[1024];
     va_list args;
 
     va_start(args, fmt);
-    vsprintf(buf, fmt, args);
 
-    me->cb.log(me_, node, me->udata, buf);
+    if (me->cb.log_event)
+    {
+        raft_log_event_t ev;
+        const char* p;
+
+        ev.level = level;
+        ev.fmt = fmt;
+        ev.n_args = 0;
+        for (p = strchr(fmt, '%'); p && ev.n_args < RAFT_LOG_MAX_ARGS;
+             p = strchr(p + 1, '%'))
+        {
+            p = __conversion(p);
+            if ('%' == *p)
+                continue;
+            else if ('s' == *p)
+                ev.args[ev.n_args++].s = va_arg(args, const char*);
+            else
+                ev.args[ev.n_args++].i = va_arg(args, int);
+        }
+
+        me->cb.log_event(me_, node, me->udata, &ev);
+    }
+    else if (me->cb.log)
+    {
+        char buf[1024];
+        vsnprintf(buf, sizeof(buf), fmt, args);
+        me->cb.log(me_, node, me->udata, buf);
+    }
+
+    va_end(args);
+}
+
+int raft_log_event_format(const raft_log_event_t* ev, char* buf, int len)
+{
+    const char* p = ev->fmt;
+    int arg = 0, n = 0;
+
+    if (len <= 0)
+        return 0;
+
+    buf[0] = '\0';
+
+    while (*p && n < len - 1)
+    {
+        if ('%' != *p)
+        {
+            buf[n++] = *p++;
+            continue;
+        }
+
+        const char* end = __conversion(p);
+        char spec[32];
+        int spec_len = (int)(end - p) + 1;
+
+        if ('\0' == *end || (int)sizeof(spec) <= spec_len)
+            break;
+
+        memcpy(spec, p, spec_len);
+        spec[spec_len] = '\0';
+        p = end + 1;
+
+        int w;
+        if ('%' == *end)
+            w = snprintf(buf + n, len - n, "%%");
+        else if (ev->n_args <= arg)
+            break;
+        else if ('s' == *end)
+            w = snprintf(buf + n, len - n, spec, ev->args[arg++].s);
+        else
+            w = snprintf(buf + n, len - n, spec, ev->args[arg++].i);
+
+        n += w < len - n ? w : len - n - 1;
+    }
+
+    buf[n] = '\0';
+    return n;
+}
+
+void raft_update_log_level(raft_server_t* me_)
+{
+    raft_server_private_t* me = (raft_server_private_t*)me_;
+
+    if (me->cb.log || me->cb.log_event)
+        me->log_level = me->log_level_wanted;
+    else
+        me->log_level = RAFT_LOG_NONE;
 }
 
 void raft_randomize_election_timeout(raft_server_t* me_)
@@ -47,7 +140,8 @@ void raft_randomize_election_timeout(raft_server_t* me_)
 
     /* [election_timeout, 2 * election_timeout) */
     me->election_timeout_rand = me->election_timeout + rand() % me->election_timeout;
-    __log(me_, NULL, "randomize election timeout to %d", me->election_timeout_rand);
+    __log(me_, RAFT_LOG_DEBUG, NULL, "randomize election timeout to %d",
+          me->election_timeout_rand);
 }
 
 raft_server_t* raft_new()
@@ -61,6 +155,9 @@ raft_server_t* raft_new()
     me->timeout_elapsed = 0;
     me->request_timeout = 200;
     me->election_timeout = 1000;
+    me->log_level_wanted = RAFT_LOG_DEBUG;
+    me->lease_max_drift = -1;
+    me->timeoutnow_term = -1;
     raft_randomize_election_timeout((raft_server_t*)me);
     me->log = log_new();
     if (!me->log) {
@@ -80,12 +177,23 @@ void raft_set_callbacks(raft_server_t* me_, raft_cbs_t* funcs, void* udata)
     memcpy(&me->cb, funcs, sizeof(raft_cbs_t));
     me->udata = udata;
     log_set_callbacks(me->log, &me->cb, me_);
+    raft_update_log_level(me_);
 }
 
 void raft_free(raft_server_t* me_)
 {
     raft_server_private_t* me = (raft_server_private_t*)me_;
+    int i;
 
+    while (me->reads_head)
+    {
+        raft_read_request_t* read = me->reads_head;
+        me->reads_head = read->next;
+        free(read);
+    }
+    for (i = 0; i < me->num_nodes; i++)
+        raft_node_free(me->nodes[i]);
+    free(me->nodes);
     log_free(me->log);
     free(me_);
 }
@@ -93,19 +201,29 @@ void raft_free(raft_server_t* me_)
 void raft_clear(raft_server_t* me_)
 {
     raft_server_private_t* me = (raft_server_private_t*)me_;
+    int i;
+
+    for (i = 0; i < me->num_nodes; i++)
+        raft_node_free(me->nodes[i]);
 
     me->current_term = 0;
     me->voted_for = -1;
+    me->timeoutnow_term = -1;
     me->timeout_elapsed = 0;
     raft_randomize_election_timeout(me_);
     me->voting_cfg_change_log_idx = -1;
     raft_set_state((raft_server_t*)me, RAFT_STATE_FOLLOWER);
     me->current_leader = NULL;
+    me->transfer_target = NULL;
     me->commit_idx = 0;
     me->last_applied_idx = 0;
     me->num_nodes = 0;
     me->node = NULL;
     me->voting_cfg_change_log_idx = 0;
+    me->snapshot_last_idx = 0;
+    me->snapshot_last_term = 0;
+    me->snapshot_in_progress_idx = 0;
+    me->snapshot_in_progress_term = 0;
     log_clear(me->log);
 }
 
@@ -121,26 +239,138 @@ int raft_delete_entry_from_idx(raft_server_t* me_, int idx)
     return log_delete(me->log, idx);
 }
 
+/**
+ * @return 1 if the node votes in the old or new configuration */
+static int __is_voter(raft_node_t* node)
+{
+    return raft_node_is_voting(node) || raft_node_is_voting_new(node);
+}
+
+/**
+ * Tell if the nodes that count form a majority of the voting nodes. During a
+ * joint configuration change they must be a majority of both the old and the
+ * new configuration.
+ * @param counts Asked of each voting node, including us
+ * @param arg Passed to counts
+ * @return 1 if the nodes that count are a quorum */
+static int __is_quorum(raft_server_private_t* me,
+                       int (*counts)(raft_server_private_t* me,
+                                     raft_node_t* node, void* arg),
+                       void* arg)
+{
+    int i, old_voters = 0, new_voters = 0, old_votes = 0, new_votes = 0;
+
+    for (i = 0; i < me->num_nodes; i++)
+    {
+        raft_node_t* node = me->nodes[i];
+        int is_old = raft_node_is_voting(node);
+        int is_new = raft_node_is_voting_new(node);
+        if (!is_old && !is_new)
+            continue;
+        old_voters += is_old;
+        new_voters += is_new;
+        if (counts(me, node, arg))
+        {
+            old_votes += is_old;
+            new_votes += is_new;
+        }
+    }
+
+    return raft_votes_is_majority(old_voters, old_votes) &&
+           raft_votes_is_majority(new_voters, new_votes);
+}
+
+static int __is_me(raft_server_private_t* me, raft_node_t* node, void* arg)
+{
+    return me->node == node;
+}
+
+static int __has_prevoted(raft_server_private_t* me, raft_node_t* node,
+                          void* arg)
+{
+    return me->node == node || raft_node_has_prevote_for_me(node);
+}
+
+static int __has_voted(raft_server_private_t* me, raft_node_t* node, void* arg)
+{
+    if (me->node == node)
+        return me->voted_for == raft_get_nodeid((void*)me);
+    return raft_node_has_vote_for_me(node);
+}
+
+/** @param arg The entry index */
+static int __has_entry(raft_server_private_t* me, raft_node_t* node, void* arg)
+{
+    return me->node == node || *(int*)arg <= raft_node_get_match_idx(node);
+}
+
+/** @param arg The msg_id */
+static int __has_acked(raft_server_private_t* me, raft_node_t* node, void* arg)
+{
+    return me->node == node ||
+           *(int*)arg <= raft_node_get_last_acked_msgid(node);
+}
+
+static int __has_responded(raft_server_private_t* me, raft_node_t* node,
+                           void* arg)
+{
+    return me->node == node ||
+           me->quorum_checked_at <= raft_node_get_last_response(node);
+}
+
 int raft_election_start(raft_server_t* me_)
 {
     raft_server_private_t* me = (raft_server_private_t*)me_;
 
-    __log(me_, NULL, "election starting: %d %d, term: %d ci: %d",
+    __log(me_, RAFT_LOG_INFO, NULL, "election starting: %d %d, term: %d ci: %d",
           me->election_timeout_rand, me->timeout_elapsed, me->current_term,
           raft_get_current_idx(me_));
 
+    me->transfer_election = 0;
+
+    if (me->cb.send_prevote)
+    {
+        raft_prevote_start(me_);
+        return 0;
+    }
+
     return raft_become_candidate(me_);
 }
 
+void raft_prevote_start(raft_server_t* me_)
+{
+    raft_server_private_t* me = (raft_server_private_t*)me_;
+    int i;
+
+    __log(me_, RAFT_LOG_INFO, NULL, "becoming pre-candidate term:%d",
+          me->current_term + 1);
+
+    for (i = 0; i < me->num_nodes; i++)
+        raft_node_prevote_for_me(me->nodes[i], 0);
+    me->prevoting = 1;
+    me->current_leader = NULL;
+
+    raft_randomize_election_timeout(me_);
+    me->timeout_elapsed = 0;
+
+    for (i = 0; i < me->num_nodes; i++)
+        if (me->node != me->nodes[i] && __is_voter(me->nodes[i]))
+            raft_send_prevote(me_, me->nodes[i]);
+}
+
 void raft_become_leader(raft_server_t* me_)
 {
     raft_server_private_t* me = (raft_server_private_t*)me_;
     int i;
 
-    __log(me_, NULL, "becoming leader term:%d", raft_get_current_term(me_));
+    __log(me_, RAFT_LOG_INFO, NULL, "becoming leader term:%d", raft_get_current_term(me_));
 
     raft_set_state(me_, RAFT_STATE_LEADER);
     me->timeout_elapsed = 0;
+    me->lease_msg_id = 0;
+    me->lease_expiry = 0;
+    me->quorum_checked_at = me->now;
+    me->learner_budget = me->learner_bandwidth * 1000L;
     for (i = 0; i < me->num_nodes; i++)
     {
         if (me->node == me->nodes[i])
@@ -149,6 +379,8 @@ void raft_become_leader(raft_server_t* me_)
         raft_node_t* node = me->nodes[i];
         raft_node_set_next_idx(node, raft_get_current_idx(me_) + 1);
         raft_node_set_match_idx(node, 0);
+        /* the guess only sends new entries, so being wrong costs nothing */
+        raft_node_set_progress(node, RAFT_NODE_PROGRESS_REPLICATE);
         raft_send_appendentries(me_, node);
     }
 }
@@ -158,7 +390,7 @@ int raft_become_candidate(raft_server_t* me_)
     raft_server_private_t* me = (raft_server_private_t*)me_;
     int i;
 
-    __log(me_, NULL, "becoming candidate");
+    __log(me_, RAFT_LOG_INFO, NULL, "becoming candidate");
 
     int e = raft_set_current_term(me_, raft_get_current_term(me_) + 1);
     if (0 != e)
@@ -173,7 +405,7 @@ int raft_become_candidate(raft_server_t* me_)
     me->timeout_elapsed = 0;
 
     for (i = 0; i < me->num_nodes; i++)
-        if (me->node != me->nodes[i] && raft_node_is_voting(me->nodes[i]))
+        if (me->node != me->nodes[i] && __is_voter(me->nodes[i]))
             raft_send_requestvote(me_, me->nodes[i]);
     return 0;
 }
@@ -182,33 +414,153 @@ void raft_become_follower(raft_server_t* me_)
 {
     raft_server_private_t* me = (raft_server_private_t*)me_;
 
-    __log(me_, NULL, "becoming follower");
+    __log(me_, RAFT_LOG_INFO, NULL, "becoming follower");
     raft_set_state(me_, RAFT_STATE_FOLLOWER);
     raft_randomize_election_timeout(me_);
     me->timeout_elapsed = 0;
 }
 
+/**
+ * Append entries to our log as the leader, and send them to voters that are
+ * up to date.
+ * @return 0 on success */
+static int __append_entries(raft_server_t* me_,
+                            msg_entry_t* entries,
+                            int n_entries,
+                            msg_entry_response_t *r)
+{
+    raft_server_private_t* me = (raft_server_private_t*)me_;
+    int i, e = 0;
+    int first_idx = raft_get_current_idx(me_) + 1;
+
+    for (i = 0; i < n_entries; i++)
+    {
+        msg_entry_t* ety = &entries[i];
+
+        __log(me_, RAFT_LOG_DEBUG, NULL, "received entry t:%d id: %d idx: %d",
+              me->current_term, ety->id, raft_get_current_idx(me_) + 1);
+
+        ety->term = me->current_term;
+        e = raft_append_entry(me_, ety);
+        if (0 != e)
+            break;
+
+        r[i].id = ety->id;
+        r[i].idx = raft_get_current_idx(me_);
+        r[i].term = me->current_term;
+
+        if (raft_entry_is_voting_cfg_change(ety))
+            me->voting_cfg_change_log_idx = raft_get_current_idx(me_);
+    }
+
+    if (0 == i)
+        return e;
+
+    for (i = 0; i < me->num_nodes; i++)
+    {
+        if (me->node == me->nodes[i] || !me->nodes[i] ||
+            !__is_voter(me->nodes[i]) ||
+            RAFT_NODE_PROGRESS_REPLICATE != raft_node_get_progress(me->nodes[i]))
+            continue;
+
+        /* Only send new entries.
+         * Don't send the entries to peers who are behind, to prevent them
+         * from becoming congested. */
+        int next_idx = raft_node_get_next_idx(me->nodes[i]);
+        if (next_idx == first_idx)
+            raft_send_appendentries(me_, me->nodes[i]);
+    }
+
+    /* if we're the only node, we can consider the entries committed */
+    if (__is_quorum(me, __is_me, NULL))
+        raft_set_commit_idx(me_, raft_get_current_idx(me_));
+
+    return e;
+}
+
+/**
+ * Switch to the new configuration once the joint one is committed.
+ * @return 0 on success */
+static int __append_leave_joint(raft_server_t* me_)
+{
+    msg_entry_t ety;
+    msg_entry_response_t r;
+
+    __log(me_, RAFT_LOG_INFO, NULL, "leaving joint configuration");
+
+    memset(&ety, 0, sizeof(ety));
+    ety.type = RAFT_LOGTYPE_LEAVE_JOINT;
+    return __append_entries(me_, &ety, 1, &r);
+}
+
 int raft_periodic(raft_server_t* me_, int msec_since_last_period)
 {
     raft_server_private_t* me = (raft_server_private_t*)me_;
 
     me->timeout_elapsed += msec_since_last_period;
+    me->now += msec_since_last_period;
 
-    /* Only one voting node means it's safe for us to become the leader */
-    if (1 == raft_get_num_voting_nodes(me_) &&
-        raft_node_is_voting(raft_get_my_node((void*)me)) &&
-        !raft_is_leader(me_))
+    /* Being a quorum on our own means it's safe for us to become the leader */
+    if (!raft_is_leader(me_) && __is_quorum(me, __is_me, NULL))
         raft_become_leader(me_);
 
     if (me->state == RAFT_STATE_LEADER)
     {
-        if (me->request_timeout <= me->timeout_elapsed)
+        /* checked once per election timeout, so a leader cut off from the
+         * majority steps down within two */
+        if (me->check_quorum &&
+            me->election_timeout <= me->now - me->quorum_checked_at)
+        {
+            if (!__is_quorum(me, __has_responded, NULL))
+            {
+                __log(me_, RAFT_LOG_INFO, NULL,
+                      "lost contact with the majority");
+                me->quorum_step_downs += 1;
+                raft_become_follower(me_);
+                me->current_leader = NULL;
+                goto apply;
+            }
+            me->quorum_checked_at = me->now;
+        }
+
+        if (me->transfer_target)
+        {
+            me->transfer_elapsed += msec_since_last_period;
+            if (me->election_timeout <= me->transfer_elapsed)
+            {
+                __log(me_, RAFT_LOG_INFO, me->transfer_target,
+                      "leadership transfer timed out");
+                me->transfer_target = NULL;
+            }
+        }
+
+        /* at most a second's worth is saved up, and a debt is paid off
+         * first */
+        if (me->learner_bandwidth)
+        {
+            me->learner_budget +=
+                (long)me->learner_bandwidth * msec_since_last_period;
+            if (me->learner_bandwidth * 1000L < me->learner_budget)
+                me->learner_budget = me->learner_bandwidth * 1000L;
+        }
+
+        /* the target must catch up, so the new configuration waits */
+        if (!me->transfer_target &&
+            !raft_voting_change_is_in_progress(me_) && raft_is_joint(me_))
+        {
+            int e = __append_leave_joint(me_);
+            if (0 != e)
+                return e;
+        }
+
+        /* reads wait for a heartbeat round sent after them */
+        if (me->request_timeout <= me->timeout_elapsed ||
+            (me->reads_tail && me->msg_id < me->reads_tail->msg_id))
             raft_send_appendentries_all(me_);
     }
     else if (me->election_timeout_rand <= me->timeout_elapsed)
     {
-        if (1 < raft_get_num_voting_nodes(me_) &&
-            raft_node_is_voting(raft_get_my_node(me_)))
+        if (__is_voter(raft_get_my_node(me_)))
         {
             int e = raft_election_start(me_);
             if (0 != e)
@@ -216,6 +568,7 @@ int raft_periodic(raft_server_t* me_, int msec_since_last_period)
         }
     }
 
+apply:
     if (me->last_applied_idx < me->commit_idx)
         return raft_apply_entry(me_);
 
@@ -233,13 +586,20 @@ int raft_voting_change_is_in_progress(raft_server_t* me_)
     return ((raft_server_private_t*)me_)->voting_cfg_change_log_idx != -1;
 }
 
+/**
+ * @return 1 if a majority of voting nodes acknowledged msg_id */
+static int __msgid_is_acked(raft_server_private_t* me, int msg_id)
+{
+    return __is_quorum(me, __has_acked, &msg_id);
+}
+
 int raft_recv_appendentries_response(raft_server_t* me_,
                                      raft_node_t* node,
                                      msg_appendentries_response_t* r)
 {
     raft_server_private_t* me = (raft_server_private_t*)me_;
 
-    __log(me_, node,
+    __log(me_, RAFT_LOG_DEBUG, node,
           "received appendentries response %s ci:%d rci:%d 1stidx:%d",
           r->success == 1 ? "SUCCESS" : "fail",
           raft_get_current_idx(me_),
@@ -266,6 +626,21 @@ int raft_recv_appendentries_response(raft_server_t* me_,
     else if (me->current_term != r->term)
         return 0;
 
+    /* any response from this term confirms we were leader when the message
+     * was sent */
+    raft_node_set_last_acked_msgid(node, r->msg_id);
+    raft_node_set_last_response(node, me->now);
+    if (me->lease_msg_id && !me->transfer_target &&
+        me->timeoutnow_term != me->current_term &&
+        __msgid_is_acked(me, me->lease_msg_id))
+    {
+        me->lease_expiry = me->lease_round_start +
+            me->election_timeout * (100 - me->lease_max_drift) / 100;
+        me->lease_msg_id = 0;
+    }
+    if (me->reads_head)
+        raft_process_reads(me_);
+
     int match_idx = raft_node_get_match_idx(node);
 
     if (0 == r->success)
@@ -276,18 +651,33 @@ int raft_recv_appendentries_response(raft_server_t* me_,
         assert(0 < next_idx);
         /* Stale response -- ignore */
         assert(match_idx <= next_idx - 1);
-        if (match_idx == next_idx - 1)
+        if (match_idx == next_idx - 1 && me->snapshot_last_idx < next_idx)
             return 0;
-        if (r->current_idx < next_idx - 1)
-            raft_node_set_next_idx(node, min(r->current_idx + 1, raft_get_current_idx(me_)));
-        else
-            raft_node_set_next_idx(node, next_idx - 1);
+        raft_node_set_progress(node, RAFT_NODE_PROGRESS_PROBE);
+        if (me->snapshot_last_idx < next_idx)
+        {
+            if (r->current_idx < next_idx - 1)
+                raft_node_set_next_idx(node, min(r->current_idx + 1, raft_get_current_idx(me_)));
+            else
+                raft_node_set_next_idx(node, next_idx - 1);
+        }
+
+        /* the entries it needs were compacted; heartbeats probe again once it
+         * has installed the snapshot */
+        if (raft_node_get_next_idx(node) <= me->snapshot_last_idx)
+        {
+            if (me->cb.send_snapshot)
+                me->cb.send_snapshot(me_, me->udata, node);
+            return 0;
+        }
 
         /* retry */
         raft_send_appendentries(me_, node);
         return 0;
     }
 
+    raft_node_set_progress(node, RAFT_NODE_PROGRESS_REPLICATE);
+
     if (r->current_idx <= match_idx)
         return 0;
 
@@ -296,7 +686,11 @@ int raft_recv_appendentries_response(raft_server_t* me_,
     raft_node_set_next_idx(node, r->current_idx + 1);
     raft_node_set_match_idx(node, r->current_idx);
 
-    if (!raft_node_is_voting(node) &&
+    if (node == me->transfer_target && !me->transfer_timeoutnow_sent &&
+        r->current_idx == raft_get_current_idx(me_))
+        raft_send_timeoutnow(me_, node);
+
+    if (!__is_voter(node) &&
         !raft_voting_change_is_in_progress(me_) &&
         raft_get_current_idx(me_) <= r->current_idx + 1 &&
         me->cb.node_has_sufficient_logs &&
@@ -313,22 +707,10 @@ int raft_recv_appendentries_response(raft_server_t* me_,
     if (point)
     {
         raft_entry_t* ety = raft_get_entry_from_idx(me_, point);
-        if (raft_get_commit_idx(me_) < point && ety->term == me->current_term)
-        {
-            int i, votes = 1;
-            for (i = 0; i < me->num_nodes; i++)
-            {
-                if (me->node != me->nodes[i] &&
-                    raft_node_is_voting(me->nodes[i]) &&
-                    point <= raft_node_get_match_idx(me->nodes[i]))
-                {
-                    votes++;
-                }
-            }
-
-            if (raft_get_num_voting_nodes(me_) / 2 < votes)
-                raft_set_commit_idx(me_, point);
-        }
+        if (raft_get_commit_idx(me_) < point && ety &&
+            ety->term == me->current_term &&
+            __is_quorum(me, __has_entry, &point))
+            raft_set_commit_idx(me_, point);
     }
 
     /* Aggressively send remaining entries */
@@ -351,7 +733,7 @@ int raft_recv_appendentries(
     int e = 0;
 
     if (0 < ae->n_entries)
-        __log(me_, node, "recvd appendentries t:%d ci:%d lc:%d pli:%d plt:%d #%d",
+        __log(me_, RAFT_LOG_DEBUG, node, "recvd appendentries t:%d ci:%d lc:%d pli:%d plt:%d #%d",
               ae->term,
               raft_get_current_idx(me_),
               ae->leader_commit,
@@ -375,19 +757,31 @@ int raft_recv_appendentries(
     else if (ae->term < me->current_term)
     {
         /* 1. Reply false if term < currentTerm (§5.1) */
-        __log(me_, node, "AE term %d is less than current term %d",
+        __log(me_, RAFT_LOG_DEBUG, node, "AE term %d is less than current term %d",
               ae->term, me->current_term);
         goto out;
     }
 
     /* update current leader because ae->term is up to date */
     me->current_leader = node;
+    me->prevoting = 0;
 
     me->timeout_elapsed = 0;
 
     /* Not the first appendentries we've received */
     /* NOTE: the log starts at 1 */
-    if (0 < ae->prev_log_idx)
+    if (0 < ae->prev_log_idx && ae->prev_log_idx == me->snapshot_last_idx)
+    {
+        if (me->snapshot_last_term != ae->prev_log_term)
+        {
+            /* the snapshot is committed, so the leader has it too */
+            __log(me_, RAFT_LOG_DEBUG, node, "AE prev_term doesn't match snapshot's (ie. %d vs %d)",
+                  me->snapshot_last_term, ae->prev_log_term);
+            goto out;
+        }
+    }
+    /* entries up to the snapshot are committed, so they match */
+    else if (me->snapshot_last_idx < ae->prev_log_idx)
     {
         raft_entry_t* ety = raft_get_entry_from_idx(me_, ae->prev_log_idx);
 
@@ -395,13 +789,13 @@ int raft_recv_appendentries(
            whose term matches prevLogTerm (§5.3) */
         if (!ety)
         {
-            __log(me_, node, "AE no log at prev_idx %d", ae->prev_log_idx);
+            __log(me_, RAFT_LOG_DEBUG, node, "AE no log at prev_idx %d", ae->prev_log_idx);
             goto out;
         }
 
         if (ety->term != ae->prev_log_term)
         {
-            __log(me_, node, "AE term doesn't match prev_term (ie. %d vs %d) ci:%d pli:%d",
+            __log(me_, RAFT_LOG_DEBUG, node, "AE term doesn't match prev_term (ie. %d vs %d) ci:%d pli:%d",
                   ety->term, ae->prev_log_term, raft_get_current_idx(me_), ae->prev_log_idx);
             /* Delete all the following log entries because they don't match */
             e = raft_delete_entry_from_idx(me_, ae->prev_log_idx);
@@ -420,6 +814,11 @@ int raft_recv_appendentries(
     {
         raft_entry_t* ety = &ae->entries[i];
         int ety_index = ae->prev_log_idx + 1 + i;
+        if (ety_index <= me->snapshot_last_idx)
+        {
+            r->current_idx = ety_index;
+            continue;
+        }
         raft_entry_t* existing_ety = raft_get_entry_from_idx(me_, ety_index);
         if (existing_ety && existing_ety->term != ety->term && me->commit_idx < ety_index)
         {
@@ -443,18 +842,19 @@ int raft_recv_appendentries(
     }
 
     /* 4. If leaderCommit > commitIndex, set commitIndex =
-        min(leaderCommit, index of most recent entry) */
-    if (raft_get_commit_idx(me_) < ae->leader_commit)
-    {
-        int last_log_idx = max(raft_get_current_idx(me_), 1);
-        raft_set_commit_idx(me_, min(last_log_idx, ae->leader_commit));
-    }
+        min(leaderCommit, index of last new entry)
+       Entries after it may not match the leader's yet, eg. when the leader
+       probes without sending entries */
+    if (raft_get_commit_idx(me_) < ae->leader_commit &&
+        raft_get_commit_idx(me_) < r->current_idx)
+        raft_set_commit_idx(me_, min(r->current_idx, ae->leader_commit));
 
 out:
     r->term = me->current_term;
     if (0 == r->success)
         r->current_idx = raft_get_current_idx(me_);
     r->first_idx = ae->prev_log_idx + 1;
+    r->msg_id = ae->msg_id;
     return e;
 }
 
@@ -463,14 +863,42 @@ int raft_already_voted(raft_server_t* me_)
     return ((raft_server_private_t*)me_)->voted_for != -1;
 }
 
-static int __should_grant_vote(raft_server_private_t* me, msg_requestvote_t* vr)
+/**
+ * @return 1 if a log ending with last_log_idx/last_log_term is at least as
+ *  up-to-date as ours */
+static int __log_is_up_to_date(raft_server_private_t* me,
+                               int last_log_idx, int last_log_term)
 {
-    /* TODO: 4.2.3 Raft Dissertation:
-     * if a server receives a RequestVote request within the minimum election
-     * timeout of hearing from a current leader, it does not update its term or
-     * grant its vote */
+    int current_idx = raft_get_current_idx((void*)me);
 
-    if (!raft_node_is_voting(raft_get_my_node((void*)me)))
+    /* Our log is definitely not more up-to-date if it's empty! */
+    if (0 == current_idx)
+        return 1;
+
+    int term = raft_get_last_log_term((void*)me);
+    if (term < last_log_term)
+        return 1;
+
+    if (last_log_term == term && current_idx <= last_log_idx)
+        return 1;
+
+    return 0;
+}
+
+/** 4.2.3 Raft Dissertation:
+ * if a server receives a RequestVote request within the minimum election
+ * timeout of hearing from a current leader, it does not update its term or
+ * grant its vote.
+ * This stops removed servers, which don't receive heartbeats, from disrupting
+ * the cluster. A leader hears from itself. */
+static int __leader_is_alive(raft_server_private_t* me)
+{
+    return me->current_leader && me->timeout_elapsed < me->election_timeout;
+}
+
+static int __should_grant_vote(raft_server_private_t* me, msg_requestvote_t* vr)
+{
+    if (!__is_voter(raft_get_my_node((void*)me)))
         return 0;
 
     if (vr->term < raft_get_current_term((void*)me))
@@ -480,22 +908,25 @@ static int __should_grant_vote(raft_server_private_t* me, msg_requestvote_t* vr)
     if (raft_already_voted((void*)me))
         return 0;
 
-    /* Below we check if log is more up-to-date... */
-
-    int current_idx = raft_get_current_idx((void*)me);
+    return __log_is_up_to_date(me, vr->last_log_idx, vr->last_log_term);
+}
 
-    /* Our log is definitely not more up-to-date if it's empty! */
-    if (0 == current_idx)
-        return 1;
+static int __should_grant_prevote(raft_server_private_t* me, msg_prevote_t* pv)
+{
+    if (!__is_voter(raft_get_my_node((void*)me)))
+        return 0;
 
-    raft_entry_t* ety = raft_get_entry_from_idx((void*)me, current_idx);
-    if (ety->term < vr->last_log_term)
-        return 1;
+    /* the candidate's requestvote wouldn't be newer than our term */
+    if (pv->term <= raft_get_current_term((void*)me))
+        return 0;
 
-    if (vr->last_log_term == ety->term && current_idx <= vr->last_log_idx)
-        return 1;
+    if (__leader_is_alive(me))
+    {
+        me->suppressed_votes += 1;
+        return 0;
+    }
 
-    return 0;
+    return __log_is_up_to_date(me, pv->last_log_idx, pv->last_log_term);
 }
 
 int raft_recv_requestvote(raft_server_t* me_,
@@ -509,6 +940,15 @@ int raft_recv_requestvote(raft_server_t* me_,
     if (!node)
         node = raft_get_node(me_, vr->candidate_id);
 
+    if (!vr->transfer_leader &&
+        __leader_is_alive(me) && me->current_term < vr->term)
+    {
+        me->suppressed_votes += 1;
+        r->vote_granted = node ? RAFT_REQUESTVOTE_ERR_NOT_GRANTED :
+                          RAFT_REQUESTVOTE_ERR_UNKNOWN_NODE;
+        goto done;
+    }
+
     if (raft_get_current_term(me_) < vr->term)
     {
         e = raft_set_current_term(me_, vr->term);
@@ -554,8 +994,8 @@ int raft_recv_requestvote(raft_server_t* me_,
     }
 
 done:
-    __log(me_, node, "node requested vote: %d replying: %s",
-          node,
+    __log(me_, RAFT_LOG_DEBUG, node, "node requested vote: %d replying: %s",
+          vr->candidate_id,
           r->vote_granted == 1 ? "granted" :
           r->vote_granted == 0 ? "not granted" : "unknown");
 
@@ -563,6 +1003,63 @@ done:
     return e;
 }
 
+int raft_recv_prevote(raft_server_t* me_,
+                      raft_node_t* node,
+                      msg_prevote_t* pv,
+                      msg_prevote_response_t *r)
+{
+    raft_server_private_t* me = (raft_server_private_t*)me_;
+
+    r->vote_granted = __should_grant_prevote(me, pv);
+    r->term = raft_get_current_term(me_);
+    r->prevote_term = pv->term;
+
+    __log(me_, RAFT_LOG_DEBUG, node, "node requested pre-vote: %d replying: %s",
+          pv->candidate_id,
+          r->vote_granted == 1 ? "granted" : "not granted");
+
+    return 0;
+}
+
+int raft_recv_prevote_response(raft_server_t* me_,
+                               raft_node_t* node,
+                               msg_prevote_response_t* r)
+{
+    raft_server_private_t* me = (raft_server_private_t*)me_;
+
+    __log(me_, RAFT_LOG_DEBUG, node, "node responded to pre-vote status:%s ct:%d rt:%d",
+          r->vote_granted == 1 ? "granted" : "not granted",
+          me->current_term,
+          r->term);
+
+    if (!me->prevoting)
+        return 0;
+    else if (raft_get_current_term(me_) < r->term)
+    {
+        int e = raft_set_current_term(me_, r->term);
+        if (0 != e)
+            return e;
+        raft_become_follower(me_);
+        me->current_leader = NULL;
+        return 0;
+    }
+    else if (r->prevote_term != raft_get_current_term(me_) + 1)
+    {
+        /* response to an earlier pre-vote round */
+        return 0;
+    }
+
+    if (1 != r->vote_granted || !node)
+        return 0;
+
+    raft_node_prevote_for_me(node, 1);
+
+    if (__is_quorum(me, __has_prevoted, NULL))
+        return raft_become_candidate(me_);
+
+    return 0;
+}
+
 int raft_votes_is_majority(const int num_nodes, const int nvotes)
 {
     if (num_nodes < nvotes)
@@ -577,7 +1074,7 @@ int raft_recv_requestvote_response(raft_server_t* me_,
 {
     raft_server_private_t* me = (raft_server_private_t*)me_;
 
-    __log(me_, node, "node responded to requestvote status: %s",
+    __log(me_, RAFT_LOG_DEBUG, node, "node responded to requestvote status: %s",
           r->vote_granted == 1 ? "granted" :
           r->vote_granted == 0 ? "not granted" : "unknown");
 
@@ -585,6 +1082,15 @@ int raft_recv_requestvote_response(raft_server_t* me_,
     {
         return 0;
     }
+    else if (RAFT_REQUESTVOTE_ERR_UNKNOWN_NODE == r->vote_granted)
+    {
+        /* A server that still follows a leader answers without adopting our
+         * term, so this is checked regardless of the term */
+        if (raft_node_is_voting(raft_get_my_node(me_)) &&
+            me->connected == RAFT_NODE_STATUS_DISCONNECTING)
+            return RAFT_ERR_SHUTDOWN;
+        return 0;
+    }
     else if (raft_get_current_term(me_) < r->term)
     {
         int e = raft_set_current_term(me_, r->term);
@@ -602,7 +1108,7 @@ int raft_recv_requestvote_response(raft_server_t* me_,
         return 0;
     }
 
-    __log(me_, node, "node responded to requestvote status:%s ct:%d rt:%d",
+    __log(me_, RAFT_LOG_DEBUG, node, "node responded to requestvote status:%s ct:%d rt:%d",
           r->vote_granted == 1 ? "granted" :
           r->vote_granted == 0 ? "not granted" : "unknown",
           me->current_term,
@@ -613,20 +1119,13 @@ int raft_recv_requestvote_response(raft_server_t* me_,
         case RAFT_REQUESTVOTE_ERR_GRANTED:
             if (node)
                 raft_node_vote_for_me(node, 1);
-            int votes = raft_get_nvotes_for_me(me_);
-            if (raft_votes_is_majority(raft_get_num_voting_nodes(me_), votes))
+            if (__is_quorum(me, __has_voted, NULL))
                 raft_become_leader(me_);
             break;
 
         case RAFT_REQUESTVOTE_ERR_NOT_GRANTED:
             break;
 
-        case RAFT_REQUESTVOTE_ERR_UNKNOWN_NODE:
-            if (raft_node_is_voting(raft_get_my_node(me_)) &&
-                me->connected == RAFT_NODE_STATUS_DISCONNECTING)
-                return RAFT_ERR_SHUTDOWN;
-            break;
-
         default:
             assert(0);
     }
@@ -638,50 +1137,40 @@ int raft_recv_entry(raft_server_t* me_,
                     msg_entry_t* ety,
                     msg_entry_response_t *r)
 {
-    raft_server_private_t* me = (raft_server_private_t*)me_;
-    int i;
-
-    /* Only one voting cfg change at a time */
-    if (raft_entry_is_voting_cfg_change(ety))
-        if (raft_voting_change_is_in_progress(me_))
-            return RAFT_ERR_ONE_VOTING_CHANGE_ONLY;
-
-    if (!raft_is_leader(me_))
-        return RAFT_ERR_NOT_LEADER;
+    return raft_recv_entries(me_, ety, 1, r);
+}
 
-    __log(me_, NULL, "received entry t:%d id: %d idx: %d",
-          me->current_term, ety->id, raft_get_current_idx(me_) + 1);
+int raft_recv_entries(raft_server_t* me_,
+                      msg_entry_t* entries,
+                      int n_entries,
+                      msg_entry_response_t *r)
+{
+    raft_server_private_t* me = (raft_server_private_t*)me_;
+    int i, n_voting_changes = 0, n_joint_changes = 0;
 
-    ety->term = me->current_term;
-    int e = raft_append_entry(me_, ety);
-    if (0 != e)
-        return e;
-    for (i = 0; i < me->num_nodes; i++)
+    /* Only one voting cfg change at a time, but a joint change stages all of
+     * its nodes at once */
+    for (i = 0; i < n_entries; i++)
     {
-        if (me->node == me->nodes[i] || !me->nodes[i] ||
-            !raft_node_is_voting(me->nodes[i]))
-            continue;
-
-        /* Only send new entries.
-         * Don't send the entry to peers who are behind, to prevent them from
-         * becoming congested. */
-        int next_idx = raft_node_get_next_idx(me->nodes[i]);
-        if (next_idx == raft_get_current_idx(me_))
-            raft_send_appendentries(me_, me->nodes[i]);
+        if (raft_entry_is_voting_cfg_change(&entries[i]))
+            n_voting_changes += 1;
+        if (RAFT_LOGTYPE_JOINT_ADD_NODE == entries[i].type ||
+            RAFT_LOGTYPE_JOINT_DEMOTE_NODE == entries[i].type)
+            n_joint_changes += 1;
     }
+    if ((1 < n_voting_changes && n_joint_changes != n_voting_changes) ||
+        (n_voting_changes && (raft_voting_change_is_in_progress(me_) ||
+                              raft_is_joint(me_))))
+        return RAFT_ERR_ONE_VOTING_CHANGE_ONLY;
 
-    /* if we're the only node, we can consider the entry committed */
-    if (1 == raft_get_num_voting_nodes(me_))
-        raft_set_commit_idx(me_, raft_get_current_idx(me_));
-
-    r->id = ety->id;
-    r->idx = raft_get_current_idx(me_);
-    r->term = me->current_term;
+    if (!raft_is_leader(me_))
+        return RAFT_ERR_NOT_LEADER;
 
-    if (raft_entry_is_voting_cfg_change(ety))
-        me->voting_cfg_change_log_idx = raft_get_current_idx(me_);
+    /* the target must catch up, so stop making it fall behind */
+    if (me->transfer_target)
+        return RAFT_ERR_LEADER_TRANSFER_IN_PROGRESS;
 
-    return 0;
+    return __append_entries(me_, entries, n_entries, r);
 }
 
 int raft_send_requestvote(raft_server_t* me_, raft_node_t* node)
@@ -693,25 +1182,111 @@ int raft_send_requestvote(raft_server_t* me_, raft_node_t* node)
     assert(node);
     assert(node != me->node);
 
-    __log(me_, node, "sending requestvote to: %d", node);
+    __log(me_, RAFT_LOG_DEBUG, node, "sending requestvote to: %d",
+          raft_node_get_id(node));
 
     rv.term = me->current_term;
     rv.last_log_idx = raft_get_current_idx(me_);
     rv.last_log_term = raft_get_last_log_term(me_);
     rv.candidate_id = raft_get_nodeid(me_);
+    rv.transfer_leader = me->transfer_election;
     if (me->cb.send_requestvote)
         e = me->cb.send_requestvote(me_, me->udata, node, &rv);
     return e;
 }
 
+int raft_send_prevote(raft_server_t* me_, raft_node_t* node)
+{
+    raft_server_private_t* me = (raft_server_private_t*)me_;
+    msg_prevote_t pv;
+
+    assert(node);
+    assert(node != me->node);
+
+    __log(me_, RAFT_LOG_DEBUG, node, "sending pre-vote to: %d",
+          raft_node_get_id(node));
+
+    pv.term = me->current_term + 1;
+    pv.last_log_idx = raft_get_current_idx(me_);
+    pv.last_log_term = raft_get_last_log_term(me_);
+    pv.candidate_id = raft_get_nodeid(me_);
+    return me->cb.send_prevote(me_, me->udata, node, &pv);
+}
+
+int raft_send_timeoutnow(raft_server_t* me_, raft_node_t* node)
+{
+    raft_server_private_t* me = (raft_server_private_t*)me_;
+    msg_timeoutnow_t msg;
+
+    assert(node);
+    assert(node != me->node);
+
+    __log(me_, RAFT_LOG_INFO, node, "sending timeoutnow to: %d",
+          raft_node_get_id(node));
+
+    me->transfer_timeoutnow_sent = 1;
+    me->timeoutnow_term = me->current_term;
+    msg.term = me->current_term;
+    return me->cb.send_timeoutnow(me_, me->udata, node, &msg);
+}
+
+int raft_transfer_leader(raft_server_t* me_, int node_id)
+{
+    raft_server_private_t* me = (raft_server_private_t*)me_;
+
+    if (!raft_is_leader(me_))
+        return RAFT_ERR_NOT_LEADER;
+
+    if (me->transfer_target)
+        return RAFT_ERR_LEADER_TRANSFER_IN_PROGRESS;
+
+    /* the target has to keep its vote once a joint change completes */
+    raft_node_t* node = raft_get_node(me_, node_id);
+    if (!node || node == me->node || !raft_node_is_voting_new(node))
+        return RAFT_ERR_INVALID_TRANSFER_TARGET;
+
+    __log(me_, RAFT_LOG_INFO, node, "transferring leadership to: %d", node_id);
+
+    me->transfer_target = node;
+    me->transfer_elapsed = 0;
+    me->transfer_timeoutnow_sent = 0;
+
+    /* the target could be elected before our lease runs out */
+    me->lease_expiry = 0;
+    me->lease_msg_id = 0;
+
+    if (raft_node_get_match_idx(node) == raft_get_current_idx(me_))
+        return raft_send_timeoutnow(me_, node);
+
+    return raft_send_appendentries(me_, node);
+}
+
+int raft_recv_timeoutnow(raft_server_t* me_,
+                         raft_node_t* node,
+                         msg_timeoutnow_t* msg)
+{
+    raft_server_private_t* me = (raft_server_private_t*)me_;
+
+    __log(me_, RAFT_LOG_INFO, node, "received timeoutnow t:%d", msg->term);
+
+    /* only the current leader may hand over */
+    if (msg->term != me->current_term || !raft_is_follower(me_) ||
+        !__is_voter(raft_get_my_node(me_)))
+        return 0;
+
+    me->transfer_election = 1;
+    return raft_become_candidate(me_);
+}
+
 int raft_append_entry(raft_server_t* me_, raft_entry_t* ety)
 {
     raft_server_private_t* me = (raft_server_private_t*)me_;
 
-    if (raft_entry_is_voting_cfg_change(ety))
+    int e = log_append_entry(me->log, ety);
+    if (0 == e && raft_entry_is_voting_cfg_change(ety))
         me->voting_cfg_change_log_idx = raft_get_current_idx(me_);
 
-    return log_append_entry(me->log, ety);
+    return e;
 }
 
 int raft_apply_entry(raft_server_t* me_)
@@ -728,7 +1303,7 @@ int raft_apply_entry(raft_server_t* me_)
     if (!ety)
         return -1;
 
-    __log(me_, NULL, "applying log: %d, id: %d size: %d",
+    __log(me_, RAFT_LOG_DEBUG, NULL, "applying log: %d, id: %d size: %d",
           me->last_applied_idx, ety->id, ety->data.len);
 
     me->last_applied_idx++;
@@ -740,18 +1315,37 @@ int raft_apply_entry(raft_server_t* me_)
     }
 
     /* Membership Change: confirm connection with cluster */
-    if (RAFT_LOGTYPE_ADD_NODE == ety->type)
+    if (RAFT_LOGTYPE_ADD_NODE == ety->type ||
+        RAFT_LOGTYPE_JOINT_ADD_NODE == ety->type)
     {
         int node_id = me->cb.log_get_node_id(me_, raft_get_udata(me_), ety, log_idx);
         raft_node_set_has_sufficient_logs(raft_get_node(me_, node_id));
         if (node_id == raft_get_nodeid(me_))
             me->connected = RAFT_NODE_STATUS_CONNECTED;
     }
+    else if (RAFT_LOGTYPE_LEAVE_JOINT == ety->type)
+    {
+        /* committed, so it's never popped and needn't take effect earlier */
+        int i;
+        for (i = 0; i < me->num_nodes; i++)
+            raft_node_set_voting(me->nodes[i],
+                                 raft_node_is_voting_new(me->nodes[i]));
+
+        /* a leader outside of the new configuration steps down (§4.2.2) */
+        if (raft_is_leader(me_) && !raft_node_is_voting(me->node))
+        {
+            raft_become_follower(me_);
+            me->current_leader = NULL;
+        }
+    }
 
     /* voting cfg change is now complete */
     if (log_idx == me->voting_cfg_change_log_idx)
         me->voting_cfg_change_log_idx = -1;
 
+    if (me->reads_head)
+        raft_process_reads(me_);
+
     return 0;
 }
 
@@ -773,14 +1367,40 @@ int raft_send_appendentries(raft_server_t* me_, raft_node_t* node)
 
     msg_appendentries_t ae = {};
     ae.term = me->current_term;
+    ae.msg_id = me->msg_id;
     ae.leader_commit = raft_get_commit_idx(me_);
     ae.prev_log_idx = 0;
     ae.prev_log_term = 0;
 
     int next_idx = raft_node_get_next_idx(node);
 
+    /* probe from the snapshot; if the node doesn't have it, it rejects this
+     * and is sent the snapshot */
+    int probe = RAFT_NODE_PROGRESS_PROBE == raft_node_get_progress(node);
+    if (next_idx <= me->snapshot_last_idx)
+    {
+        next_idx = me->snapshot_last_idx + 1;
+        probe = 1;
+    }
+
     ae.entries = raft_get_entries_from_idx(me_, next_idx, &ae.n_entries);
 
+    if (probe)
+        ae.n_entries = 0;
+    else if (me->learner_bandwidth && !__is_voter(node))
+    {
+        /* send what the learners' budget allows; a full budget always
+         * sends an entry, going into debt if it's bigger than a second's
+         * worth, or that entry could never be sent */
+        long full = me->learner_bandwidth * 1000L;
+        int i;
+        for (i = 0; i < ae.n_entries &&
+             (ae.entries[i].data.len * 1000L <= me->learner_budget ||
+              (0 == i && full <= me->learner_budget)); i++)
+            me->learner_budget -= ae.entries[i].data.len * 1000L;
+        ae.n_entries = i;
+    }
+
     /* previous log is the log just before the new logs */
     if (1 < next_idx)
     {
@@ -788,9 +1408,11 @@ int raft_send_appendentries(raft_server_t* me_, raft_node_t* node)
         ae.prev_log_idx = next_idx - 1;
         if (prev_ety)
             ae.prev_log_term = prev_ety->term;
+        else if (ae.prev_log_idx == me->snapshot_last_idx)
+            ae.prev_log_term = me->snapshot_last_term;
     }
 
-    __log(me_, node, "sending appendentries node: ci:%d comi:%d t:%d lc:%d pli:%d plt:%d",
+    __log(me_, RAFT_LOG_DEBUG, node, "sending appendentries node: ci:%d comi:%d t:%d lc:%d pli:%d plt:%d",
           raft_get_current_idx(me_),
           raft_get_commit_idx(me_),
           ae.term,
@@ -807,6 +1429,13 @@ int raft_send_appendentries_all(raft_server_t* me_)
     int i, e;
 
     me->timeout_elapsed = 0;
+    me->msg_id++;
+    if (-1 != me->lease_max_drift && 0 == me->lease_msg_id &&
+        !me->transfer_target)
+    {
+        me->lease_msg_id = me->msg_id;
+        me->lease_round_start = me->now;
+    }
     for (i = 0; i < me->num_nodes; i++)
     {
         if (me->node != me->nodes[i])
@@ -948,10 +1577,209 @@ int raft_apply_all(raft_server_t* me_)
     return 0;
 }
 
+/**
+ * @return 1 if the leader has committed an entry in its current term; until
+ *  then it can't know the commit idx of the previous leader */
+static int __committed_in_term(raft_server_private_t* me)
+{
+    if (0 == me->commit_idx)
+        return 0;
+
+    if (me->commit_idx == me->snapshot_last_idx)
+        return me->snapshot_last_term == me->current_term;
+
+    raft_entry_t* ety = raft_get_entry_from_idx((void*)me, me->commit_idx);
+    return ety && ety->term == (unsigned int)me->current_term;
+}
+
+int raft_read_request(raft_server_t* me_, void* read_udata)
+{
+    raft_server_private_t* me = (raft_server_private_t*)me_;
+
+    if (!raft_is_leader(me_))
+        return RAFT_ERR_NOT_LEADER;
+
+    raft_read_request_t* read = malloc(sizeof(*read));
+    if (!read)
+        return RAFT_ERR_NOMEM;
+    read->read_idx = __committed_in_term(me) ? me->commit_idx : -1;
+    read->msg_id = me->msg_id + 1;
+    read->udata = read_udata;
+
+    /* within the lease nobody else can be leader, so there's no need to
+     * confirm it; keep msg_id ordered behind earlier reads */
+    if (-1 != me->lease_max_drift && me->now < me->lease_expiry &&
+        -1 != read->read_idx)
+        read->msg_id = me->reads_tail ? me->reads_tail->msg_id : 0;
+    read->next = NULL;
+
+    if (me->reads_tail)
+        me->reads_tail->next = read;
+    else
+        me->reads_head = read;
+    me->reads_tail = read;
+
+    /* a lone voter is its own majority */
+    raft_process_reads(me_);
+    return 0;
+}
+
+void raft_process_reads(raft_server_t* me_)
+{
+    raft_server_private_t* me = (raft_server_private_t*)me_;
+    int acked_msg_id = 0;
+
+    if (!raft_is_leader(me_) || !__committed_in_term(me))
+        return;
+
+    while (me->reads_head)
+    {
+        raft_read_request_t* read = me->reads_head;
+
+        /* reads are queued in msg_id order, so only check each id once */
+        if (acked_msg_id < read->msg_id)
+        {
+            if (!__msgid_is_acked(me, read->msg_id))
+                break;
+            acked_msg_id = read->msg_id;
+        }
+
+        if (-1 == read->read_idx)
+            read->read_idx = me->commit_idx;
+        if (me->last_applied_idx < read->read_idx)
+            break;
+
+        me->reads_head = read->next;
+        if (!me->reads_head)
+            me->reads_tail = NULL;
+        me->cb.read_response(me_, me->udata, read->udata, 0);
+        free(read);
+    }
+}
+
+void raft_clear_reads(raft_server_t* me_, int status)
+{
+    raft_server_private_t* me = (raft_server_private_t*)me_;
+
+    while (me->reads_head)
+    {
+        raft_read_request_t* read = me->reads_head;
+        me->reads_head = read->next;
+        if (!me->reads_head)
+            me->reads_tail = NULL;
+        me->cb.read_response(me_, me->udata, read->udata, status);
+        free(read);
+    }
+}
+
+int raft_begin_snapshot(raft_server_t* me_)
+{
+    raft_server_private_t* me = (raft_server_private_t*)me_;
+    int i;
+
+    if (me->snapshot_in_progress_idx ||
+        me->last_applied_idx <= me->snapshot_last_idx)
+        return -1;
+
+    for (i = me->last_applied_idx + 1; i <= raft_get_current_idx(me_); i++)
+        if (raft_entry_is_cfg_change(raft_get_entry_from_idx(me_, i)))
+            return -1;
+
+    me->snapshot_in_progress_idx = me->last_applied_idx;
+    me->snapshot_in_progress_term =
+        raft_get_entry_from_idx(me_, me->last_applied_idx)->term;
+    return 0;
+}
+
+int raft_end_snapshot(raft_server_t* me_)
+{
+    raft_server_private_t* me = (raft_server_private_t*)me_;
+
+    /* a snapshot loaded since supersedes it */
+    if (me->snapshot_in_progress_idx <= me->snapshot_last_idx)
+    {
+        me->snapshot_in_progress_idx = 0;
+        return -1;
+    }
+
+    while (log_get_base(me->log) < me->snapshot_in_progress_idx)
+    {
+        void* ety;
+        int e = log_poll(me->log, &ety);
+        if (0 != e)
+            return e;
+    }
+
+    me->snapshot_last_idx = me->snapshot_in_progress_idx;
+    me->snapshot_last_term = me->snapshot_in_progress_term;
+    me->snapshot_in_progress_idx = 0;
+    me->snapshot_in_progress_term = 0;
+
+    __log(me_, RAFT_LOG_INFO, NULL, "compacted log up to %d", me->snapshot_last_idx);
+    return 0;
+}
+
+int raft_begin_load_snapshot(raft_server_t* me_, int last_idx, int last_term)
+{
+    raft_server_private_t* me = (raft_server_private_t*)me_;
+    int i, e;
+
+    /* a leader or candidate may be the only one with entries it'd discard */
+    if (!raft_is_follower(me_))
+        return RAFT_ERR_NOT_FOLLOWER;
+
+    if (last_idx <= me->commit_idx)
+        return RAFT_ERR_STALE_SNAPSHOT;
+
+    /* entries we have past the snapshot might not match the leader's; it
+     * sends them again. Whichever callback fails, the rest are dropped
+     * without one when the log is emptied. */
+    e = log_delete(me->log, me->commit_idx + 1);
+    while (0 == e && 0 < log_count(me->log))
+    {
+        void* ety;
+        e = log_poll(me->log, &ety);
+    }
+    log_load_from_snapshot(me->log, last_idx);
+
+    me->commit_idx = last_idx;
+    me->last_applied_idx = last_idx;
+    me->snapshot_last_idx = last_idx;
+    me->snapshot_last_term = last_term;
+    me->snapshot_in_progress_idx = 0;
+    me->snapshot_in_progress_term = 0;
+    me->voting_cfg_change_log_idx = -1;
+
+    /* the leader is known again from its next appendentries */
+    me->current_leader = NULL;
+    for (i = me->num_nodes - 1; 0 <= i; i--)
+        if (me->nodes[i] != me->node)
+            raft_remove_node(me_, me->nodes[i]);
+
+    __log(me_, RAFT_LOG_INFO, NULL, "loading snapshot up to %d", last_idx);
+    return e;
+}
+
+void raft_end_load_snapshot(raft_server_t* me_)
+{
+    raft_server_private_t* me = (raft_server_private_t*)me_;
+    int i;
+
+    for (i = 0; i < me->num_nodes; i++)
+        if (raft_node_is_voting(me->nodes[i]))
+            raft_node_set_has_sufficient_logs(me->nodes[i]);
+
+    if (me->node && raft_node_is_voting(me->node))
+        me->connected = RAFT_NODE_STATUS_CONNECTED;
+}
+
 int raft_entry_is_voting_cfg_change(raft_entry_t* ety)
 {
     return RAFT_LOGTYPE_ADD_NODE == ety->type ||
-           RAFT_LOGTYPE_DEMOTE_NODE == ety->type;
+           RAFT_LOGTYPE_DEMOTE_NODE == ety->type ||
+           RAFT_LOGTYPE_JOINT_ADD_NODE == ety->type ||
+           RAFT_LOGTYPE_JOINT_DEMOTE_NODE == ety->type ||
+           RAFT_LOGTYPE_LEAVE_JOINT == ety->type;
 }
 
 int raft_entry_is_cfg_change(raft_entry_t* ety)
@@ -960,14 +1788,19 @@ int raft_entry_is_cfg_change(raft_entry_t* ety)
         RAFT_LOGTYPE_ADD_NODE == ety->type ||
         RAFT_LOGTYPE_ADD_NONVOTING_NODE == ety->type ||
         RAFT_LOGTYPE_DEMOTE_NODE == ety->type ||
-        RAFT_LOGTYPE_REMOVE_NODE == ety->type);
+        RAFT_LOGTYPE_REMOVE_NODE == ety->type ||
+        RAFT_LOGTYPE_JOINT_ADD_NODE == ety->type ||
+        RAFT_LOGTYPE_JOINT_DEMOTE_NODE == ety->type ||
+        RAFT_LOGTYPE_LEAVE_JOINT == ety->type);
 }
 
 void raft_offer_log(raft_server_t* me_, raft_entry_t* ety, const int idx)
 {
     raft_server_private_t* me = (raft_server_private_t*)me_;
 
-    if (!raft_entry_is_cfg_change(ety))
+    /* the new configuration takes effect when it's applied */
+    if (!raft_entry_is_cfg_change(ety) ||
+        RAFT_LOGTYPE_LEAVE_JOINT == ety->type)
         return;
 
     int node_id = me->cb.log_get_node_id(me_, raft_get_udata(me_), ety, idx);
@@ -994,6 +1827,19 @@ void raft_offer_log(raft_server_t* me_, raft_entry_t* ety, const int idx)
             raft_node_set_voting(node, 0);
             break;
 
+        case RAFT_LOGTYPE_JOINT_ADD_NODE:
+            if (!node)
+            {
+                node = raft_add_non_voting_node(me_, NULL, node_id, is_self);
+                assert(node);
+            }
+            raft_node_set_voting_new(node, 1);
+            break;
+
+        case RAFT_LOGTYPE_JOINT_DEMOTE_NODE:
+            raft_node_set_voting_new(node, 0);
+            break;
+
         case RAFT_LOGTYPE_REMOVE_NODE:
             if (node)
                 raft_remove_node(me_, node);
@@ -1008,13 +1854,22 @@ void raft_pop_log(raft_server_t* me_, raft_entry_t* ety, const int idx)
 {
     raft_server_private_t* me = (raft_server_private_t*)me_;
 
-    if (!raft_entry_is_cfg_change(ety))
+    if (!raft_entry_is_cfg_change(ety) ||
+        RAFT_LOGTYPE_LEAVE_JOINT == ety->type)
         return;
 
     int node_id = me->cb.log_get_node_id(me_, raft_get_udata(me_), ety, idx);
 
     switch (ety->type)
     {
+        case RAFT_LOGTYPE_JOINT_ADD_NODE:
+            raft_node_set_voting_new(raft_get_node(me_, node_id), 0);
+            break;
+
+        case RAFT_LOGTYPE_JOINT_DEMOTE_NODE:
+            raft_node_set_voting_new(raft_get_node(me_, node_id), 1);
+            break;
+
         case RAFT_LOGTYPE_DEMOTE_NODE:
             {
             raft_node_t* node = raft_get_node(me_, node_id);
@@ -26,6 +26,32 @@ void raft_set_election_timeout(raft_server_t* me_, int millisec)
     raft_randomize_election_timeout(me_);
 }
 
+void raft_set_log_level(raft_server_t* me_, int level)
+{
+    raft_server_private_t* me = (raft_server_private_t*)me_;
+    me->log_level_wanted = level;
+    raft_update_log_level(me_);
+}
+
+void raft_set_lease_reads(raft_server_t* me_, int max_drift)
+{
+    raft_server_private_t* me = (raft_server_private_t*)me_;
+    me->lease_max_drift = max_drift;
+}
+
+void raft_set_check_quorum(raft_server_t* me_, int enabled)
+{
+    raft_server_private_t* me = (raft_server_private_t*)me_;
+    me->check_quorum = enabled;
+}
+
+void raft_set_learner_bandwidth(raft_server_t* me_, int bytes_per_sec)
+{
+    raft_server_private_t* me = (raft_server_private_t*)me_;
+    me->learner_bandwidth = bytes_per_sec;
+    me->learner_budget = bytes_per_sec * 1000L;
+}
+
 void raft_set_request_timeout(raft_server_t* me_, int millisec)
 {
     raft_server_private_t* me = (raft_server_private_t*)me_;
@@ -65,6 +91,17 @@ int raft_get_num_voting_nodes(raft_server_t* me_)
     return num;
 }
 
+int raft_is_joint(raft_server_t* me_)
+{
+    raft_server_private_t* me = (raft_server_private_t*)me_;
+    int i;
+    for (i = 0; i < me->num_nodes; i++)
+        if (raft_node_is_voting(me->nodes[i]) !=
+            raft_node_is_voting_new(me->nodes[i]))
+            return 1;
+    return 0;
+}
+
 int raft_get_timeout_elapsed(raft_server_t* me_)
 {
     return ((raft_server_private_t*)me_)->timeout_elapsed;
@@ -96,6 +133,7 @@ int raft_set_current_term(raft_server_t* me_, const int term)
         }
         me->current_term = term;
         me->voted_for = voted_for;
+        me->prevoting = 0;
     }
     return 0;
 }
@@ -138,10 +176,19 @@ int raft_get_commit_idx(raft_server_t* me_)
 void raft_set_state(raft_server_t* me_, int state)
 {
     raft_server_private_t* me = (raft_server_private_t*)me_;
+    /* pending reads can't be confirmed once we aren't the leader */
+    if (me->state == RAFT_STATE_LEADER && state != RAFT_STATE_LEADER)
+    {
+        raft_clear_reads(me_, RAFT_ERR_NOT_LEADER);
+        me->transfer_target = NULL;
+    }
+    if (state != RAFT_STATE_CANDIDATE)
+        me->transfer_election = 0;
     /* if became the leader, then update the current leader entry */
     if (state == RAFT_STATE_LEADER)
         me->current_leader = me->node;
     me->state = state;
+    me->prevoting = 0;
 }
 
 int raft_get_state(raft_server_t* me_)
@@ -213,18 +260,46 @@ int raft_is_candidate(raft_server_t* me_)
     return raft_get_state(me_) == RAFT_STATE_CANDIDATE;
 }
 
+int raft_get_suppressed_votes(raft_server_t* me_)
+{
+    return ((raft_server_private_t*)me_)->suppressed_votes;
+}
+
+int raft_get_quorum_step_downs(raft_server_t* me_)
+{
+    return ((raft_server_private_t*)me_)->quorum_step_downs;
+}
+
+int raft_is_prevoting(raft_server_t* me_)
+{
+    return ((raft_server_private_t*)me_)->prevoting;
+}
+
 int raft_get_last_log_term(raft_server_t* me_)
 {
+    raft_server_private_t* me = (raft_server_private_t*)me_;
     int current_idx = raft_get_current_idx(me_);
     if (0 < current_idx)
     {
         raft_entry_t* ety = raft_get_entry_from_idx(me_, current_idx);
         if (ety)
             return ety->term;
+        if (current_idx == me->snapshot_last_idx)
+            return me->snapshot_last_term;
     }
     return 0;
 }
 
+int raft_get_snapshot_last_idx(raft_server_t* me_)
+{
+    return ((raft_server_private_t*)me_)->snapshot_last_idx;
+}
+
+int raft_get_snapshot_last_term(raft_server_t* me_)
+{
+    return ((raft_server_private_t*)me_)->snapshot_last_term;
+}
+
 int raft_is_connected(raft_server_t* me_)
 {
     return ((raft_server_private_t*)me_)->connected;
@@ -2,12 +2,128 @@
 #define STATE_MACHINE_H
 
 #include <stdlib.h>
+#include <stdint.h>
 
 typedef void* fsm_t;
 
+/* What a state machine's random commands look like */
+typedef struct {
+    /* number of keys, or cells, random commands pick from */
+    int key_space;
+
+    /* sizes of the values random commands set, where commands have values;
+     * value_dist is of type fsm_value_dist_e */
+    int value_size;
+    int value_dist;
+} fsm_config_t;
+
+/* Common to the snapshots of every state machine; the first member of each */
+typedef struct {
+    /* bytes the snapshot serializes to */
+    int64_t size;
+
+    /* the state machine's digest when the snapshot was taken */
+    uint64_t digest;
+
+    /* digest of what was serialized so far; equals digest once done */
+    uint64_t read_digest;
+
+    /* stat: pages the state machine copied because the snapshot shared them */
+    int pages_copied;
+} fsm_snapshot_t;
+
+/* A state machine's operations, so that the simulator can run any of them.
+ * Commands are whole entries, and snapshots serialize to a stream of
+ * commands that restore() applies to an empty state machine. */
+typedef struct {
+    /* as given to --fsm */
+    const char* name;
+
+    /* bytes of a command that cmd_size() needs to tell its size */
+    int cmd_header_size;
+
+    /* most bytes a command can have */
+    int cmd_max_size;
+
+    fsm_t (*new)(fsm_config_t* config);
+
+    void (*free)(fsm_t me);
+
+    void (*push)(fsm_t me, void* cmd);
+
+    /** Apply n commands in order */
+    void (*push_batch)(fsm_t me, void** cmds, int n);
+
+    /**
+     * @param key Key number, 0 to key_space - 1, that the command acts on
+     * @return a malloc'd command doing something random to the key */
+    void* (*cmd)(fsm_t me, int key);
+
+    /** @return bytes of the command; -1 if its header is invalid */
+    int (*cmd_size)(void* cmd);
+
+    /**
+     * @param n Key number, 0 to key_space - 1
+     * @param[out] key Key n, in at least FSM_KVSTORE_KEY_MAX bytes
+     * @return the key's length */
+    int (*key)(fsm_t me, int n, char* key);
+
+    /** Read a key, as a client read would once it's safe */
+    void (*read)(fsm_t me, const char* key, int key_len);
+
+    /** @return a hash of the state, kept up to date as commands are pushed */
+    uint64_t (*digest)(fsm_t me);
+
+    /**
+     * @param[out] n_keys Keys, or cells, held
+     * @param[out] bytes Bytes of state */
+    void (*size)(fsm_t me, int* n_keys, long* bytes);
+
+    /**
+     * Take a snapshot; the state machine can keep changing while it's
+     * serialized, and the snapshot still sees it as it was.
+     * @return the snapshot, or NULL if the state machine already has one */
+    fsm_snapshot_t* (*snapshot)(fsm_t me);
+
+    /**
+     * Serialize the next part of a snapshot. Commands may be split across
+     * calls.
+     * @return bytes written, or 0 once the whole snapshot has been */
+    int (*snapshot_read)(fsm_snapshot_t* snap, char* buf, int size);
+
+    void (*snapshot_free)(fsm_snapshot_t* snap);
+
+    /**
+     * Apply a command from a snapshot
+     * @return 0 on success; -1 if it isn't a command a snapshot has */
+    int (*restore)(fsm_t me, void* cmd);
+} fsm_ops_t;
+
+/* the cells of fsm_simple_t */
+extern fsm_ops_t fsm_simple_ops;
+
+/* fsm_kvstore_t */
+extern fsm_ops_t fsm_kvstore_ops;
+
+/* fsm_kvstore_t doing FSM_HEAVY_ROUNDS extra passes over every command it
+ * applies, like a state machine maintaining indexes or checksums would */
+extern fsm_ops_t fsm_heavy_ops;
+
+#define FSM_HEAVY_ROUNDS 32
+
 typedef struct {
     int *cells;
     int size;
+
+    /* sum of a hash of every cell, see fsm_simple_digest() */
+    uint64_t digest;
+
+    /* the snapshot being serialized, or NULL */
+    struct fsm_simple_snapshot_s* snapshot;
+
+    /* what fsm_simple_ops.push_batch() gathers commands into; NULL until
+     * it's first used */
+    struct fsm_simple_batch_s* batch;
 } fsm_simple_t;
 
 typedef struct {
@@ -20,19 +136,284 @@ typedef struct {
     int value;
 } fsm_simple_cmd_t;
 
-typedef fsm_simple_t fsm_kvstore_t;
-typedef fsm_simple_cmd_t fsm_kvstore_cmd_t;
+/* Commands as a structure of arrays, so that fsm_simple_push_batch() can
+ * apply them in loops without branches. The arrays are padded past size, so
+ * that the loops can run whole vectors. */
+typedef struct fsm_simple_batch_s {
+    int* type;
+    int* cell;
+    int* value;
+
+    /* commands in the batch, and most it can hold */
+    int n;
+    int size;
+
+    /* per command: what it adds to its cell, a mask of the bits of the cell
+     * it keeps, and the cell before and after */
+    int* add;
+    int* keep;
+    int* before;
+    int* after;
+} fsm_simple_batch_t;
+
+/* A copy of the cells; they're few enough to copy when it's taken */
+typedef struct fsm_simple_snapshot_s {
+    fsm_snapshot_t base;
+
+    fsm_simple_t* fsm;
+
+    int* cells;
+    int size;
+
+    /* where fsm_simple_snapshot_read() is up to: a cell, and an offset into
+     * the command setting it */
+    int cell;
+    int offset;
+} fsm_simple_snapshot_t;
+
+/* longest key fsm_kvstore_rand_key() makes, including the terminating 0 */
+#define FSM_KVSTORE_KEY_MAX 32
+
+/* largest value fsm_kvstore_rand_cmd() makes */
+#define FSM_KVSTORE_VALUE_MAX 65536
+
+/* how the sizes of values vary around the mean */
+typedef enum {
+    FSM_VALUE_FIXED,
+    /* uniform between 0 and twice the mean */
+    FSM_VALUE_UNIFORM,
+    /* exponential, so most values are small and a few are large */
+    FSM_VALUE_EXP,
+} fsm_value_dist_e;
+
+typedef struct {
+    /* the key followed by the value in one allocation; NULL if the slot is
+     * empty */
+    char* key;
+    int key_len;
+
+    int value_len;
+
+    /* hash of the key and value; its share of the store's digest */
+    uint64_t digest;
+
+    /* the store's version when the key was last set */
+    unsigned int version;
+} fsm_kvstore_slot_t;
+
+/* slots per page; snapshots share the slots a page at a time */
+#define FSM_KVSTORE_PAGE_SLOTS 256
+
+struct fsm_kvstore_snapshot_s;
+
+/* Open addressing hash table with linear probing */
+typedef struct {
+    /* n_slots / FSM_KVSTORE_PAGE_SLOTS pages of slots */
+    fsm_kvstore_slot_t** pages;
+
+    /* a power of two, and at least FSM_KVSTORE_PAGE_SLOTS */
+    int n_slots;
+
+    int n_keys;
+
+    /* bytes of keys and values stored */
+    long bytes;
+
+    /* sum of the slots' digests, so that it doesn't depend on the order
+     * keys were inserted in, or on the size of the table */
+    uint64_t digest;
+
+    /* number of keys fsm_kvstore_rand_cmd() picks from */
+    int key_space;
+
+    /* sizes of the values fsm_kvstore_rand_cmd() sets */
+    int value_size;
+    int value_dist;
+
+    /* bumped by every snapshot, so that a record set since can't be in it */
+    unsigned int version;
+
+    /* the snapshot being serialized, or NULL */
+    struct fsm_kvstore_snapshot_s* snapshot;
+
+    /* extra passes over every command applied, and what they add up to */
+    int rounds;
+    uint64_t work;
+} fsm_kvstore_t;
+
+/* A consistent view of a store, taken without copying it. The store copies
+ * a page before it first changes it, and keeps records the snapshot can
+ * still see until the snapshot is freed. */
+typedef struct fsm_kvstore_snapshot_s {
+    fsm_snapshot_t base;
+
+    fsm_kvstore_t* store;
+
+    /* the store's pages when the snapshot was taken */
+    fsm_kvstore_slot_t** pages;
+    int n_pages;
+
+    /* the store's version when the snapshot was taken */
+    unsigned int version;
+
+    /* the store's size when the snapshot was taken */
+    int n_keys;
+    long bytes;
+
+    /* overwritten or deleted records the snapshot can still see */
+    char** retired;
+    int n_retired;
+    int retired_size;
+
+    /* where fsm_kvstore_snapshot_read() is up to: a slot, and an offset
+     * into its serialized record */
+    int slot;
+    int offset;
+} fsm_kvstore_snapshot_t;
+
+/* A command, which is the whole entry; variable length */
+typedef struct {
+    int type;
+
+    int key_len;
+
+    int value_len;
+
+    /* the key followed by the value */
+    char data[];
+} fsm_kvstore_cmd_t;
 
 fsm_simple_t* fsm_simple_new(int size);
 
+void fsm_simple_free(fsm_simple_t* me);
+
 void fsm_simple_push(fsm_simple_t* me, fsm_simple_cmd_t* cmd);
 
+/**
+ * Apply the batch's commands in order. Same result as fsm_simple_push() on
+ * each in turn. The batch is left as it was. */
+void fsm_simple_push_batch(fsm_simple_t* me, fsm_simple_batch_t* batch);
+
+/**
+ * Make a command doing something random to a cell */
+void fsm_simple_cmd(fsm_simple_t* me, int cell, fsm_simple_cmd_t* cmd);
+
 void fsm_simple_rand_cmd(fsm_simple_t* me, fsm_simple_cmd_t* cmd);
 
-fsm_kvstore_t* fsm_kvstore_new(int size);
+/**
+ * @return 0 if both hold the same cells */
+int fsm_simple_cmp(fsm_simple_t* me, fsm_simple_t* other);
+
+/**
+ * Kept up to date by fsm_simple_push(), so it's O(1)
+ * @return a hash of the state; equal states have equal digests */
+uint64_t fsm_simple_digest(fsm_simple_t* me);
+
+/**
+ * Take a snapshot in O(cells)
+ * @return the snapshot, or NULL if there already is one */
+fsm_simple_snapshot_t* fsm_simple_snapshot(fsm_simple_t* me);
+
+/**
+ * Serialize the next part of a snapshot, as a command setting each cell.
+ * Commands may be split across calls.
+ * @return bytes written, or 0 once the whole snapshot has been */
+int fsm_simple_snapshot_read(fsm_simple_snapshot_t* me, char* buf, int size);
+
+/**
+ * Set a cell from a snapshot, see fsm_simple_snapshot_read()
+ * @return 0 on success; -1 if it isn't a command a snapshot has */
+int fsm_simple_restore(fsm_simple_t* me, fsm_simple_cmd_t* cmd);
+
+void fsm_simple_snapshot_free(fsm_simple_snapshot_t* me);
+
+/**
+ * @param size Most commands the batch can hold */
+fsm_simple_batch_t* fsm_simple_batch_new(int size);
+
+void fsm_simple_batch_free(fsm_simple_batch_t* me);
+
+/**
+ * Append a command
+ * @return 0 on success; -1 if the batch is full */
+int fsm_simple_batch_add(fsm_simple_batch_t* me, fsm_simple_cmd_t* cmd);
+
+/**
+ * @param key_space Number of keys random commands pick from
+ * @param value_size Mean size of the values random commands set
+ * @param value_dist How value sizes vary, of type fsm_value_dist_e */
+fsm_kvstore_t* fsm_kvstore_new(int key_space, int value_size, int value_dist);
+
+void fsm_kvstore_free(fsm_kvstore_t* me);
 
 void fsm_kvstore_push(fsm_kvstore_t* me, fsm_kvstore_cmd_t* cmd);
 
-void fsm_kvstore_rand_cmd(fsm_kvstore_t* me, fsm_kvstore_cmd_t* cmd);
+/**
+ * @param[out] value_len Length of the value
+ * @return the value, or NULL if the key isn't set */
+const char* fsm_kvstore_get(fsm_kvstore_t* me, const char* key, int key_len,
+                            int* value_len);
+
+/**
+ * @param n Key number, 0 to key_space - 1
+ * @param[out] key At least FSM_KVSTORE_KEY_MAX bytes
+ * @return the key's length */
+int fsm_kvstore_key(fsm_kvstore_t* me, int n, char* key);
+
+/**
+ * @param[out] key At least FSM_KVSTORE_KEY_MAX bytes
+ * @return the key's length */
+int fsm_kvstore_rand_key(fsm_kvstore_t* me, char* key);
+
+/**
+ * @param n Key number, see fsm_kvstore_key()
+ * @return a malloc'd command doing something random to the key, see
+ *  fsm_kvstore_cmd_size() */
+fsm_kvstore_cmd_t* fsm_kvstore_cmd(fsm_kvstore_t* me, int n);
+
+/**
+ * @return a malloc'd command, see fsm_kvstore_cmd_size() */
+fsm_kvstore_cmd_t* fsm_kvstore_rand_cmd(fsm_kvstore_t* me);
+
+/**
+ * @return bytes of the command, including its key and value */
+int fsm_kvstore_cmd_size(fsm_kvstore_cmd_t* cmd);
+
+/**
+ * @return 0 if both hold the same keys and values */
+int fsm_kvstore_cmp(fsm_kvstore_t* me, fsm_kvstore_t* other);
+
+/**
+ * Kept up to date by fsm_kvstore_push(), so it's O(1) however big the store
+ * is. Use fsm_kvstore_cmp() to confirm that two stores with different
+ * digests really differ.
+ * @return a hash of the keys and values; equal stores have equal digests */
+uint64_t fsm_kvstore_digest(fsm_kvstore_t* me);
+
+/**
+ * Take a snapshot in O(number of pages). The store can keep changing while
+ * the snapshot is serialized; the snapshot still sees the store as it was.
+ * @return the snapshot, or NULL if the store already has one */
+fsm_kvstore_snapshot_t* fsm_kvstore_snapshot(fsm_kvstore_t* me);
+
+/**
+ * Serialize the next part of a snapshot. The snapshot is a stream of a SET
+ * command per key (see fsm_kvstore_cmd_size()), in no particular order.
+ * Commands may be split across calls.
+ * @param[out] buf Where to write
+ * @param size Most bytes to write
+ * @return bytes written, or 0 once the whole snapshot has been */
+int fsm_kvstore_snapshot_read(fsm_kvstore_snapshot_t* me, char* buf, int size);
+
+/**
+ * Add a key from a snapshot, see fsm_kvstore_snapshot_read()
+ * @param cmd A command from the snapshot
+ * @return 0 on success; -1 if it isn't a command a snapshot has */
+int fsm_kvstore_restore(fsm_kvstore_t* me, fsm_kvstore_cmd_t* cmd);
+
+/**
+ * Release the snapshot's pages and the records only it could see. Freeing
+ * the store frees its snapshot too. */
+void fsm_kvstore_snapshot_free(fsm_kvstore_snapshot_t* me);
 
 #endif /* STATE_MACHINE_H */
@@ -0,0 +1,38 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+/* Each power of two range is split into this many linear sub-buckets.
+ * 2^5 sub-buckets keeps the recorded value within ~3% of the real one. */
+#define HISTOGRAM_SUB_BUCKET_BITS 5
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BUCKET_BITS)
+
+/* enough buckets to cover every non-negative int */
+#define HISTOGRAM_BUCKETS ((32 - HISTOGRAM_SUB_BUCKET_BITS) * HISTOGRAM_SUB_BUCKETS)
+
+/** Log-linear (HDR style) histogram of non-negative integer values */
+typedef struct {
+    long counts[HISTOGRAM_BUCKETS];
+
+    /* number of values recorded */
+    long count;
+
+    /* largest value recorded */
+    int max;
+} histogram_t;
+
+histogram_t* histogram_new();
+
+void histogram_free(histogram_t* me);
+
+void histogram_clear(histogram_t* me);
+
+/** Record a value. Negative values are recorded as 0 */
+void histogram_record(histogram_t* me, int value);
+
+/**
+ * @param[in] pct Percentile between 0 and 100
+ * @return the smallest value that pct percent of recorded values are at or
+ *  below; 0 if nothing was recorded */
+int histogram_percentile(histogram_t* me, double pct);
+
+#endif /* HISTOGRAM_H */
@@ -0,0 +1,165 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "fsm.h"
+
+#define SNAPSHOT_MAGIC 0x56525346
+
+#define SNAPSHOT_VERSION 2
+
+/* bytes of the state machine's name in the header, with its NUL */
+#define SNAPSHOT_FSM_NAME_SIZE 16
+
+/* bytes of state machine per chunk */
+#define SNAPSHOT_CHUNK_SIZE 65536
+
+/* A snapshot is a snapshot_header_t, header.n_nodes snapshot_node_t, then
+ * the state machine as serialized by fsm_ops_t.snapshot_read() in chunks,
+ * each a snapshot_chunk_t followed by its data. Every chunk but the last is
+ * header.chunk_size bytes. Integers are in host byte order.
+ *
+ * The header and every chunk carry a CRC32, so a corrupt chunk is caught as
+ * soon as it's received, and a snapshot is never installed from one. */
+typedef struct {
+    unsigned int magic;
+
+    unsigned int version;
+
+    /* fsm_ops_t.name of the state machine the snapshot was taken of, as
+     * another's can't be installed into it */
+    char fsm[SNAPSHOT_FSM_NAME_SIZE];
+
+    /* the last entry the snapshot includes, and its term; the log's base
+     * once it's installed */
+    int last_idx;
+    int last_term;
+
+    /* number of snapshot_node_t following the header */
+    int n_nodes;
+
+    int chunk_size;
+
+    /* bytes of state machine in the chunks */
+    int64_t size;
+
+    /* fsm_ops_t.digest() of the state machine */
+    uint64_t digest;
+
+    /* of the header up to here, and the nodes */
+    unsigned int crc;
+} snapshot_header_t;
+
+/* A node of the configuration as of header.last_idx */
+typedef struct {
+    int id;
+
+    int voting;
+
+    /* voting once the joint configuration change is over; the same as
+     * voting if there isn't one */
+    int voting_new;
+} snapshot_node_t;
+
+typedef struct {
+    /* bytes of state machine following */
+    int len;
+
+    /* of those bytes */
+    unsigned int crc;
+} snapshot_chunk_t;
+
+/* Writes a snapshot while holding at most a chunk of it in memory */
+typedef struct {
+    fsm_ops_t* ops;
+    fsm_snapshot_t* fsm;
+
+    /* bytes of state machine still to be put in a chunk */
+    int64_t remaining;
+
+    /* the header and nodes, then each chunk in turn */
+    char* buf;
+    int buf_len;
+
+    /* bytes of buf already read */
+    int offset;
+} snapshot_writer_t;
+
+enum {
+    SNAPSHOT_READER_HEADER,
+    SNAPSHOT_READER_NODES,
+    SNAPSHOT_READER_CHUNK_HEADER,
+    SNAPSHOT_READER_CHUNK,
+    SNAPSHOT_READER_DONE,
+    SNAPSHOT_READER_CORRUPT,
+};
+
+/* Installs a snapshot while holding at most a chunk, and a command split
+ * across two chunks, in memory */
+typedef struct {
+    fsm_ops_t* ops;
+    fsm_t fsm;
+
+    int state;
+
+    snapshot_header_t header;
+    snapshot_node_t* nodes;
+
+    snapshot_chunk_t chunk;
+
+    /* the part of the snapshot being received, see state */
+    char* part;
+    int part_len;
+    int part_size;
+
+    /* bytes of state machine received */
+    int64_t received;
+
+    /* a command that continues in the next chunk */
+    char* cmd;
+    int cmd_len;
+} snapshot_reader_t;
+
+/**
+ * @param ops The state machine's operations
+ * @param fsm Snapshot of the state machine as of last_idx
+ * @param last_idx Last entry the snapshot includes
+ * @param last_term Term of that entry
+ * @param nodes The configuration as of last_idx; copied
+ * @param n_nodes Number of nodes */
+snapshot_writer_t* snapshot_writer_new(fsm_ops_t* ops, fsm_snapshot_t* fsm,
+                                       int last_idx, int last_term,
+                                       snapshot_node_t* nodes, int n_nodes);
+
+/**
+ * Serialize the next part of the snapshot.
+ * @param[out] buf Where to write
+ * @param size Most bytes to write
+ * @return bytes written, or 0 once the whole snapshot has been */
+int snapshot_writer_read(snapshot_writer_t* me, char* buf, int size);
+
+/**
+ * The state machine snapshot isn't freed */
+void snapshot_writer_free(snapshot_writer_t* me);
+
+/**
+ * A snapshot of any other state machine than ops' is taken to be corrupt.
+ * @param ops The state machine's operations
+ * @param fsm An empty state machine to install the snapshot into */
+snapshot_reader_t* snapshot_reader_new(fsm_ops_t* ops, fsm_t fsm);
+
+/**
+ * Install the next part of a snapshot. Parts can be any size.
+ * @return 0 on success; -1 if the snapshot is corrupt, in which case the
+ *  state machine is incomplete and shouldn't be used */
+int snapshot_reader_write(snapshot_reader_t* me, const char* buf, int len);
+
+/**
+ * @return 1 once the whole snapshot is installed, and the state machine's
+ *  digest matches the one it was taken with */
+int snapshot_reader_is_done(snapshot_reader_t* me);
+
+/**
+ * The state machine isn't freed */
+void snapshot_reader_free(snapshot_reader_t* me);
+
+#endif /* SNAPSHOT_H */
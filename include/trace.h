@@ -0,0 +1,72 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+
+typedef enum {
+    /* a: new raft_state_e, b: term */
+    TRACE_STATE,
+    /* peer: destination, a: message type, b: message ID */
+    TRACE_SEND,
+    /* peer: sender, a: message type, b: message ID */
+    TRACE_RECV,
+    /* peer: destination, a: message type */
+    TRACE_DROP,
+    /* a: log idx, b: term */
+    TRACE_APPEND,
+    /* a: commit idx */
+    TRACE_COMMIT,
+    /* a: log idx, b: entry ID */
+    TRACE_APPLY,
+} trace_event_type_e;
+
+/** A fixed size binary record. Nothing is formatted until the trace is
+ * dumped. */
+typedef struct {
+    /* virtual time in microseconds */
+    unsigned long ts;
+
+    unsigned short type;
+
+    /* server slot the event happened on */
+    unsigned short node;
+
+    /* server slot on the other end of a message; -1 if none */
+    int peer;
+
+    int a;
+    int b;
+} trace_event_t;
+
+/** Ring buffer of trace events. Once full, the oldest events are
+ * overwritten so the tail of a long run is always available. */
+typedef struct {
+    trace_event_t* events;
+
+    /* number of events the ring buffer holds */
+    int size;
+
+    /* position the next event is written to */
+    int back;
+
+    /* number of events held */
+    int count;
+
+    /* stat: number of events overwritten */
+    long lost;
+} trace_t;
+
+trace_t* trace_new(int size);
+
+void trace_free(trace_t* me);
+
+void trace_record(trace_t* me, unsigned long ts, int type, int node, int peer,
+                  int a, int b);
+
+/** Write the events as Chrome trace event JSON.
+ * The output can be opened with chrome://tracing or ui.perfetto.dev.
+ * @param[in] msg_names Names of message types, indexed by message type */
+void trace_dump_chrome(trace_t* me, FILE* out, int n_nodes,
+                       const char** msg_names);
+
+#endif /* TRACE_H */
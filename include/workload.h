@@ -0,0 +1,91 @@
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+/* how client operations pick the keys they act on */
+typedef enum {
+    WORKLOAD_KEYS_UNIFORM,
+    /* key n is picked in proportion to 1 / (n + 1)^zipf_theta, so key 0 is
+     * the hottest */
+    WORKLOAD_KEYS_ZIPF,
+    /* hot_ops percent of operations go to the hot keys, the rest to the
+     * others */
+    WORKLOAD_KEYS_HOTSPOT,
+} workload_key_dist_e;
+
+typedef struct {
+    /* keys are numbered 0 to key_space - 1 */
+    int key_space;
+
+    /* of type workload_key_dist_e */
+    int key_dist;
+
+    double zipf_theta;
+
+    /* percentage of keys that are hot, being keys 0 onwards; at least one
+     * key is */
+    int hot_keys;
+
+    /* percentage of hotspot operations that go to the hot keys */
+    int hot_ops;
+
+    /* Closed loop: writes and reads per 100 iterations; over 100 for several
+     * per iteration. Only used if ops_per_sec is 0. */
+    int write_rate;
+    int read_rate;
+
+    /* Open loop: operations arriving per virtual second as a Poisson process,
+     * whatever the cluster is doing, and the percentage that are reads */
+    double ops_per_sec;
+    int read_pct;
+
+    /* every burst_every iterations (0 for never), for burst_len iterations,
+     * operations arrive burst_factor times as often and all go to hot keys */
+    int burst_every;
+    int burst_len;
+    int burst_factor;
+} workload_config_t;
+
+typedef struct {
+    workload_config_t config;
+
+    /* number of hot keys */
+    int n_hot;
+
+    /* zipf: cdf[n] is the chance of picking key n or a lower one */
+    double* cdf;
+
+    /* operations arriving per iteration in the open loop */
+    double ops_per_iter;
+
+    /* stat: operations that arrived, and those in bursts */
+    long n_writes;
+    long n_reads;
+    long n_burst_ops;
+
+    /* stat: keys picked, and those that were hot */
+    long n_keys;
+    long n_hot_keys;
+} workload_t;
+
+/**
+ * @return the workload, or NULL if the config is invalid */
+workload_t* workload_new(workload_config_t* config, int msec_per_iter);
+
+void workload_free(workload_t* me);
+
+/**
+ * @return 1 if iteration iter is in a burst */
+int workload_is_bursting(workload_t* me, long iter);
+
+/**
+ * Operations arriving during an iteration
+ * @param[out] n_writes
+ * @param[out] n_reads */
+void workload_arrivals(workload_t* me, long iter, int* n_writes, int* n_reads);
+
+/**
+ * Pick the key of the next operation
+ * @return key number, 0 to key_space - 1 */
+int workload_key(workload_t* me, long iter);
+
+#endif /* WORKLOAD_H */
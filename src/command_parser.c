@@ -16,12 +16,21 @@ struct path_parse
     int cs;
 };
 
+/**
+ * Commands name servers by a digit, which may be past the last server
+ * @return the server, or NULL if there's no such server */
+static server_t* __command_server(char digit)
+{
+    int i = digit - '0';
+    return i < sys.n_servers ? &sys.servers[i] : NULL;
+}
+
 
-#line 78 "src/command_parser.rl"
+#line 89 "src/command_parser.rl"
 
 
 
-#line 25 "src/command_parser.c"
+#line 34 "src/command_parser.c"
 static const char _path_parse_actions[] = {
 	0, 1, 0, 1, 1, 1, 2, 1, 
 	3, 1, 4, 1, 5
@@ -92,7 +101,7 @@ static const int path_parse_error = 0;
 static const int path_parse_en_main = 29;
 
 
-#line 81 "src/command_parser.rl"
+#line 92 "src/command_parser.rl"
 
 static void __init(struct path_parse *fsm, system_t* sys, parse_result_t* result)
 {
@@ -100,12 +109,12 @@ static void __init(struct path_parse *fsm, system_t* sys, parse_result_t* result
     fsm->r = result;
     fsm->node_id = 0;
     
-#line 104 "src/command_parser.c"
+#line 113 "src/command_parser.c"
 	{
 	 fsm->cs = path_parse_start;
 	}
 
-#line 88 "src/command_parser.rl"
+#line 99 "src/command_parser.rl"
 }
 
 static void __execute(struct path_parse *fsm, const char *data, size_t len)
@@ -114,7 +123,7 @@ static void __execute(struct path_parse *fsm, const char *data, size_t len)
     const char *pe = data + len;
     //const char *eof = data + len;
     
-#line 118 "src/command_parser.c"
+#line 127 "src/command_parser.c"
 	{
 	int _klen;
 	unsigned int _trans;
@@ -188,60 +197,62 @@ _match:
 		switch ( *_acts++ )
 		{
 	case 0:
-#line 24 "src/command_parser.rl"
+#line 33 "src/command_parser.rl"
 	{
         __periodic(&sys);
         __poll_messages(&sys);
     }
 	break;
 	case 1:
-#line 29 "src/command_parser.rl"
+#line 38 "src/command_parser.rl"
 	{
-        raft_periodic(sys.servers[(*p) - '0'].raft, 500);
-        __ensure_election_safety(&sys);
-        __poll_messages(&sys);
+        server_t* sv = __command_server((*p));
+        if (sv)
+        {
+            raft_periodic(sv->raft, 500);
+            __ensure_election_safety(&sys);
+            __poll_messages(&sys);
+        }
     }
 	break;
 	case 2:
-#line 35 "src/command_parser.rl"
+#line 48 "src/command_parser.rl"
 	{
-        __push_entry(fsm->sys);
-        __server_poll_messages(&sys.servers[(*p) - '0'], &sys);
+        server_t* sv = __command_server((*p));
+        __push_entries(fsm->sys, 1);
+        if (sv)
+            __server_poll_messages(sv, &sys);
     }
 	break;
 	case 3:
-#line 40 "src/command_parser.rl"
+#line 55 "src/command_parser.rl"
 	{
-        __push_entry(fsm->sys);
-        __server_drop_messages(&sys.servers[(*p) - '0'], &sys);
+        server_t* sv = __command_server((*p));
+        __push_entries(fsm->sys, 1);
+        if (sv)
+            __server_drop_messages(sv, &sys);
     }
 	break;
 	case 4:
-#line 45 "src/command_parser.rl"
+#line 62 "src/command_parser.rl"
 	{
-        int node_id1 = *(p) - '0';
-
-        assert(0 <= node_id1 && node_id1 < sys.n_servers);
-
-        server_t* sv = &sys.servers[node_id1];
-        sv->partitioned = !sv->partitioned;
+        server_t* sv = __command_server((*p));
+        if (sv)
+            sv->partitioned = !sv->partitioned;
     }
 	break;
 	case 5:
-#line 54 "src/command_parser.rl"
+#line 68 "src/command_parser.rl"
 	{
-        int node_id1 = *(p) - '0';
-
-        assert(0 <= node_id1 && node_id1 < sys.n_servers);
-
-        server_t* node = &sys.servers[node_id1];
-
-        __toggle_membership(node);
-
-        __poll_messages(&sys);
+        server_t* node = __command_server((*p));
+        if (node)
+        {
+            __toggle_membership(node);
+            __poll_messages(&sys);
+        }
     }
 	break;
-#line 245 "src/command_parser.c"
+#line 256 "src/command_parser.c"
 		}
 	}
 
@@ -254,7 +265,7 @@ _again:
 	_out: {}
 	}
 
-#line 96 "src/command_parser.rl"
+#line 107 "src/command_parser.rl"
 }
 
 static int __finish(struct path_parse *fsm)
@@ -272,20 +283,23 @@ int parse_commands(system_t *sys, parse_result_t *result)
     struct path_parse pp;
     __init(&pp, sys, result);
 
-    char buf[1];
+    char buf[4096];
+    int n;
 
     int fd = fcntl(0, F_DUPFD, 0);
 
     /* set to non-blocking so we can exit when there isn't anything on stdin */
     fcntl(fd, F_SETFL, O_NONBLOCK);
 
-    while (0 < read(fd, buf, 1))
+    while (0 < (n = read(fd, buf, sizeof(buf))))
     {
-        // printf("reading: %c\n", *buf);
         ran = 1;
-        if (*buf == '\0')
+
+        /* commands end at a 0 */
+        char* end = memchr(buf, '\0', n);
+        __execute(&pp, buf, end ? end - buf : n);
+        if (end)
             break;
-        __execute(&pp, buf, 1);
     }
 
     __finish(&pp);
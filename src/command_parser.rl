@@ -15,6 +15,15 @@ struct path_parse
     int cs;
 };
 
+/**
+ * Commands name servers by a digit, which may be past the last server
+ * @return the server, or NULL if there's no such server */
+static server_t* __command_server(char digit)
+{
+    int i = digit - '0';
+    return i < sys.n_servers ? &sys.servers[i] : NULL;
+}
+
 %%{
     machine path_parse;
     access fsm->;
@@ -28,40 +37,42 @@ struct path_parse
     }
 
     action periodic {
-        raft_periodic(sys.servers[fc - '0'].raft, 500);
-        __ensure_election_safety(&sys);
-        __poll_messages(&sys);
+        server_t* sv = __command_server(fc);
+        if (sv)
+        {
+            raft_periodic(sv->raft, 500);
+            __ensure_election_safety(&sys);
+            __poll_messages(&sys);
+        }
     }
 
     action receive_msg_from_inbox {
-        __push_entry(fsm->sys);
-        __server_poll_messages(&sys.servers[fc - '0'], &sys);
+        server_t* sv = __command_server(fc);
+        __push_entries(fsm->sys, 1);
+        if (sv)
+            __server_poll_messages(sv, &sys);
     }
 
     action drop_msg_from_inbox {
-        __push_entry(fsm->sys);
-        __server_drop_messages(&sys.servers[fc - '0'], &sys);
+        server_t* sv = __command_server(fc);
+        __push_entries(fsm->sys, 1);
+        if (sv)
+            __server_drop_messages(sv, &sys);
     }
 
     action partition {
-        int node_id1 = *(fpc) - '0';
-
-        assert(0 <= node_id1 && node_id1 < sys.n_servers);
-
-        server_t* sv = &sys.servers[node_id1];
-        sv->partitioned = !sv->partitioned;
+        server_t* sv = __command_server(fc);
+        if (sv)
+            sv->partitioned = !sv->partitioned;
     }
 
     action togglmem {
-        int node_id1 = *(fpc) - '0';
-
-        assert(0 <= node_id1 && node_id1 < sys.n_servers);
-
-        server_t* node = &sys.servers[node_id1];
-
-        __toggle_membership(node);
-
-        __poll_messages(&sys);
+        server_t* node = __command_server(fc);
+        if (node)
+        {
+            __toggle_membership(node);
+            __poll_messages(&sys);
+        }
     }
 
     unreserved  = alnum | "-" | "." | "_" | "~" | "=";
@@ -111,20 +122,23 @@ int parse_commands(system_t *sys, parse_result_t *result)
     struct path_parse pp;
     __init(&pp, sys, result);
 
-    char buf[1];
+    char buf[4096];
+    int n;
 
     int fd = fcntl(0, F_DUPFD, 0);
 
     /* set to non-blocking so we can exit when there isn't anything on stdin */
     fcntl(fd, F_SETFL, O_NONBLOCK);
 
-    while (0 < read(fd, buf, 1))
+    while (0 < (n = read(fd, buf, sizeof(buf))))
     {
-        // printf("reading: %c\n", *buf);
         ran = 1;
-        if (*buf == '\0')
+
+        /* commands end at a 0 */
+        char* end = memchr(buf, '\0', n);
+        __execute(&pp, buf, end ? end - buf : n);
+        if (end)
             break;
-        __execute(&pp, buf, 1);
     }
 
     __finish(&pp);
@@ -1,52 +1,597 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <math.h>
 
 #include "fsm.h"
 
 enum {
     FSM_CMD_OP_SET,
     FSM_CMD_OP_GET,
+    FSM_CMD_OP_DEL,
     FSM_CMD_OP_NUM,
 };
 
-fsm_kvstore_t* fsm_kvstore_new(int size)
+#define PAGE FSM_KVSTORE_PAGE_SLOTS
+
+/* FNV-1a */
+static unsigned int __hash(const char* key, int key_len)
+{
+    unsigned int h = 2166136261u;
+    int i;
+    for (i = 0; i < key_len; i++)
+    {
+        h ^= (unsigned char)key[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/* 64 bit FNV-1a of the key's length, key and value */
+static uint64_t __digest(const char* kv, int key_len, int value_len)
+{
+    uint64_t h = UINT64_C(14695981039346656037);
+    int i;
+    for (i = 0; i < (int)sizeof(key_len); i++)
+    {
+        h ^= (unsigned char)(key_len >> (i * 8));
+        h *= UINT64_C(1099511628211);
+    }
+    for (i = 0; i < key_len + value_len; i++)
+    {
+        h ^= (unsigned char)kv[i];
+        h *= UINT64_C(1099511628211);
+    }
+    return h;
+}
+
+static fsm_kvstore_slot_t* __slot(fsm_kvstore_t* me, unsigned int i)
+{
+    return &me->pages[i / PAGE][i % PAGE];
+}
+
+/**
+ * @return 1 if the snapshot still uses the page */
+static int __is_shared(fsm_kvstore_snapshot_t* snap, fsm_kvstore_slot_t** pages,
+                       int p)
+{
+    return snap && p < snap->n_pages && snap->pages[p] == pages[p];
+}
+
+/**
+ * @return the slot, having first copied its page if the snapshot uses it */
+static fsm_kvstore_slot_t* __writable(fsm_kvstore_t* me, unsigned int i)
+{
+    fsm_kvstore_snapshot_t* snap = me->snapshot;
+    int p = i / PAGE;
+
+    if (__is_shared(snap, me->pages, p))
+    {
+        me->pages[p] = malloc(PAGE * sizeof(fsm_kvstore_slot_t));
+        memcpy(me->pages[p], snap->pages[p], PAGE * sizeof(fsm_kvstore_slot_t));
+        snap->base.pages_copied += 1;
+    }
+    return &me->pages[p][i % PAGE];
+}
+
+/**
+ * Free a record that was overwritten or deleted, unless the snapshot can
+ * still see it */
+static void __retire(fsm_kvstore_t* me, fsm_kvstore_slot_t* slot)
+{
+    fsm_kvstore_snapshot_t* snap = me->snapshot;
+
+    if (!snap || snap->version < slot->version)
+    {
+        free(slot->key);
+        return;
+    }
+
+    if (snap->retired_size <= snap->n_retired)
+    {
+        snap->retired_size = snap->retired_size ? snap->retired_size * 2 : 64;
+        snap->retired = realloc(snap->retired,
+                                snap->retired_size * sizeof(char*));
+    }
+    snap->retired[snap->n_retired++] = slot->key;
+}
+
+/**
+ * @return the index of the key's slot, or of the empty slot where it would
+ * go */
+static unsigned int __find(fsm_kvstore_t* me, const char* key, int key_len)
+{
+    unsigned int mask = me->n_slots - 1;
+    unsigned int i = __hash(key, key_len) & mask;
+
+    for (;; i = (i + 1) & mask)
+    {
+        fsm_kvstore_slot_t* slot = __slot(me, i);
+        if (!slot->key ||
+            (slot->key_len == key_len && !memcmp(slot->key, key, key_len)))
+            return i;
+    }
+}
+
+static fsm_kvstore_slot_t** __new_pages(int n_slots)
+{
+    fsm_kvstore_slot_t** pages = malloc(n_slots / PAGE * sizeof(void*));
+    int p;
+    for (p = 0; p < n_slots / PAGE; p++)
+        pages[p] = calloc(PAGE, sizeof(fsm_kvstore_slot_t));
+    return pages;
+}
+
+/**
+ * Free pages, except those the snapshot uses */
+static void __free_pages(fsm_kvstore_snapshot_t* snap,
+                         fsm_kvstore_slot_t** pages, int n_slots)
+{
+    int p;
+    for (p = 0; p < n_slots / PAGE; p++)
+        if (!__is_shared(snap, pages, p))
+            free(pages[p]);
+    free(pages);
+}
+
+static void __grow(fsm_kvstore_t* me)
+{
+    fsm_kvstore_slot_t** old = me->pages;
+    int i, n_old = me->n_slots;
+
+    me->n_slots *= 2;
+    me->pages = __new_pages(me->n_slots);
+    for (i = 0; i < n_old; i++)
+    {
+        fsm_kvstore_slot_t* slot = &old[i / PAGE][i % PAGE];
+        if (slot->key)
+            *__slot(me, __find(me, slot->key, slot->key_len)) = *slot;
+    }
+    __free_pages(me->snapshot, old, n_old);
+}
+
+/**
+ * Empty a slot, then move later slots of the same run back so that lookups
+ * don't stop early; there are no tombstones */
+static void __remove(fsm_kvstore_t* me, unsigned int hole)
+{
+    unsigned int mask = me->n_slots - 1, i;
+    fsm_kvstore_slot_t* slot = __writable(me, hole);
+
+    me->bytes -= slot->key_len + slot->value_len;
+    me->n_keys -= 1;
+    me->digest -= slot->digest;
+    __retire(me, slot);
+    slot->key = NULL;
+
+    for (i = (hole + 1) & mask; __slot(me, i)->key; i = (i + 1) & mask)
+    {
+        slot = __slot(me, i);
+        unsigned int home = __hash(slot->key, slot->key_len) & mask;
+
+        /* stays if its home is cyclically within (hole, i] */
+        if (((i - home) & mask) < ((i - hole) & mask))
+            continue;
+        *__writable(me, hole) = *slot;
+        __writable(me, i)->key = NULL;
+        hole = i;
+    }
+}
+
+fsm_kvstore_t* fsm_kvstore_new(int key_space, int value_size, int value_dist)
 {
     fsm_kvstore_t* me = calloc(1, sizeof(fsm_kvstore_t));
-    me->size = size;
-    me->cells = calloc(me->size, sizeof(int));
+    me->n_slots = PAGE;
+    me->pages = __new_pages(me->n_slots);
+    me->key_space = key_space;
+    me->value_size = value_size;
+    me->value_dist = value_dist;
     return me;
 }
 
+void fsm_kvstore_free(fsm_kvstore_t* me)
+{
+    int i;
+    if (me->snapshot)
+        fsm_kvstore_snapshot_free(me->snapshot);
+    for (i = 0; i < me->n_slots; i++)
+        free(__slot(me, i)->key);
+    __free_pages(NULL, me->pages, me->n_slots);
+    free(me);
+}
+
+/**
+ * Pass over the command's key and value me->rounds times; each pass starts
+ * from where the last left off so that none can be skipped */
+static void __work(fsm_kvstore_t* me, fsm_kvstore_cmd_t* cmd)
+{
+    uint64_t h = me->work;
+    int r, i;
+
+    for (r = 0; r < me->rounds; r++)
+        for (i = 0; i < cmd->key_len + cmd->value_len; i++)
+        {
+            h ^= (unsigned char)cmd->data[i];
+            h *= UINT64_C(1099511628211);
+        }
+    me->work = h;
+}
+
 void fsm_kvstore_push(fsm_kvstore_t* me, fsm_kvstore_cmd_t* cmd)
 {
+    fsm_kvstore_slot_t* slot;
+    unsigned int i;
+
+    if (me->rounds)
+        __work(me, cmd);
+
     switch (cmd->type) {
         case FSM_CMD_OP_SET:
-            me->cells[cmd->cell] = cmd->value;
+            /* at most 3/4 full */
+            if (me->n_slots * 3 <= (me->n_keys + 1) * 4)
+                __grow(me);
+            slot = __writable(me, __find(me, cmd->data, cmd->key_len));
+            if (!slot->key)
+            {
+                slot->key_len = cmd->key_len;
+                slot->value_len = 0;
+                slot->digest = 0;
+                me->bytes += cmd->key_len;
+                me->n_keys += 1;
+            }
+            else if (me->snapshot && slot->version <= me->snapshot->version)
+            {
+                /* the snapshot still sees the old value */
+                __retire(me, slot);
+                slot->key = NULL;
+            }
+            slot->key = realloc(slot->key, cmd->key_len + cmd->value_len);
+            memcpy(slot->key, cmd->data, cmd->key_len + cmd->value_len);
+            slot->version = me->version;
+            me->bytes += cmd->value_len - slot->value_len;
+            slot->value_len = cmd->value_len;
+            me->digest -= slot->digest;
+            slot->digest = __digest(cmd->data, cmd->key_len, cmd->value_len);
+            me->digest += slot->digest;
             break;
         case FSM_CMD_OP_GET:
-            // TODO
+            /* reads are served by fsm_kvstore_get() once raft_read_request()
+             * says it's safe, so there is nothing to apply */
+            break;
+        case FSM_CMD_OP_DEL:
+            i = __find(me, cmd->data, cmd->key_len);
+            if (__slot(me, i)->key)
+                __remove(me, i);
             break;
     }
 }
 
-void fsm_kvstore_rand_cmd(fsm_kvstore_t* me, fsm_kvstore_cmd_t* cmd)
+const char* fsm_kvstore_get(fsm_kvstore_t* me, const char* key, int key_len,
+                            int* value_len)
+{
+    fsm_kvstore_slot_t* slot = __slot(me, __find(me, key, key_len));
+    if (!slot->key)
+        return NULL;
+    *value_len = slot->value_len;
+    return slot->key + slot->key_len;
+}
+
+int fsm_kvstore_key(fsm_kvstore_t* me, int n, char* key)
+{
+    return snprintf(key, FSM_KVSTORE_KEY_MAX, "key:%d", n);
+}
+
+int fsm_kvstore_rand_key(fsm_kvstore_t* me, char* key)
+{
+    return fsm_kvstore_key(me, random() % me->key_space, key);
+}
+
+static int __rand_value_size(fsm_kvstore_t* me)
+{
+    int size;
+
+    switch (me->value_dist) {
+        case FSM_VALUE_UNIFORM:
+            size = random() % (2 * me->value_size + 1);
+            break;
+        case FSM_VALUE_EXP:
+            size = -log((random() + 1.0) / ((double)RAND_MAX + 2)) *
+                   me->value_size;
+            break;
+        default:
+            size = me->value_size;
+            break;
+    }
+
+    return size < FSM_KVSTORE_VALUE_MAX ? size : FSM_KVSTORE_VALUE_MAX;
+}
+
+fsm_kvstore_cmd_t* fsm_kvstore_cmd(fsm_kvstore_t* me, int n)
+{
+    char key[FSM_KVSTORE_KEY_MAX];
+    int type = random() % FSM_CMD_OP_NUM;
+    int key_len = fsm_kvstore_key(me, n, key);
+    int value_len = FSM_CMD_OP_SET == type ? __rand_value_size(me) : 0;
+
+    fsm_kvstore_cmd_t* cmd = malloc(sizeof(*cmd) + key_len + value_len);
+    cmd->type = type;
+    cmd->key_len = key_len;
+    cmd->value_len = value_len;
+    memcpy(cmd->data, key, key_len);
+    memset(cmd->data + key_len, 'a' + random() % 26, value_len);
+    return cmd;
+}
+
+fsm_kvstore_cmd_t* fsm_kvstore_rand_cmd(fsm_kvstore_t* me)
 {
-    cmd->type = random() % FSM_CMD_OP_NUM;
-    cmd->value = random() % 255;
-    cmd->cell = random() % me->size;
+    return fsm_kvstore_cmd(me, random() % me->key_space);
+}
+
+int fsm_kvstore_cmd_size(fsm_kvstore_cmd_t* cmd)
+{
+    return sizeof(*cmd) + cmd->key_len + cmd->value_len;
 }
 
 int fsm_kvstore_cmp(fsm_kvstore_t* me, fsm_kvstore_t* other)
 {
-    if (me->size != other->size)
-        return me->size - other->size;
-    return memcmp(me->cells, other->cells, sizeof(int) * me->size);
+    int i;
+
+    if (me->n_keys != other->n_keys)
+        return me->n_keys - other->n_keys;
+
+    for (i = 0; i < me->n_slots; i++)
+    {
+        fsm_kvstore_slot_t* slot = __slot(me, i);
+        const char* value;
+        int value_len;
+
+        if (!slot->key)
+            continue;
+        value = fsm_kvstore_get(other, slot->key, slot->key_len, &value_len);
+        if (!value)
+            return 1;
+        if (value_len != slot->value_len)
+            return value_len - slot->value_len;
+        if (memcmp(value, slot->key + slot->key_len, value_len))
+            return memcmp(value, slot->key + slot->key_len, value_len);
+    }
+
+    return 0;
+}
+
+uint64_t fsm_kvstore_digest(fsm_kvstore_t* me)
+{
+    return me->digest;
+}
+
+fsm_kvstore_snapshot_t* fsm_kvstore_snapshot(fsm_kvstore_t* me)
+{
+    if (me->snapshot)
+        return NULL;
+
+    fsm_kvstore_snapshot_t* snap = calloc(1, sizeof(*snap));
+    snap->store = me;
+    snap->n_pages = me->n_slots / PAGE;
+    snap->pages = malloc(snap->n_pages * sizeof(void*));
+    memcpy(snap->pages, me->pages, snap->n_pages * sizeof(void*));
+    snap->version = me->version++;
+    snap->n_keys = me->n_keys;
+    snap->bytes = me->bytes;
+    snap->base.size = me->bytes + (int64_t)me->n_keys * sizeof(fsm_kvstore_cmd_t);
+    snap->base.digest = me->digest;
+    me->snapshot = snap;
+    return snap;
+}
+
+int fsm_kvstore_snapshot_read(fsm_kvstore_snapshot_t* me, char* buf, int size)
+{
+    int n = 0;
+
+    while (n < size && me->slot < me->n_pages * PAGE)
+    {
+        fsm_kvstore_slot_t* slot = &me->pages[me->slot / PAGE][me->slot % PAGE];
+        if (!slot->key)
+        {
+            me->slot += 1;
+            continue;
+        }
+
+        fsm_kvstore_cmd_t cmd = {
+            .type = FSM_CMD_OP_SET,
+            .key_len = slot->key_len,
+            .value_len = slot->value_len
+        };
+        int cmd_len = fsm_kvstore_cmd_size(&cmd);
+
+        /* from the bytes rather than slot->digest, so that a record that
+         * changed under the snapshot is caught */
+        if (0 == me->offset)
+            me->base.read_digest += __digest(slot->key, slot->key_len,
+                                        slot->value_len);
+
+        while (me->offset < cmd_len && n < size)
+        {
+            const char* src;
+            int k;
+
+            if (me->offset < (int)sizeof(cmd))
+            {
+                src = (char*)&cmd + me->offset;
+                k = sizeof(cmd) - me->offset;
+            }
+            else
+            {
+                src = slot->key + me->offset - sizeof(cmd);
+                k = cmd_len - me->offset;
+            }
+            if (size - n < k)
+                k = size - n;
+            memcpy(buf + n, src, k);
+            n += k;
+            me->offset += k;
+        }
+
+        if (me->offset == cmd_len)
+        {
+            me->offset = 0;
+            me->slot += 1;
+        }
+    }
+
+    return n;
+}
+
+int fsm_kvstore_restore(fsm_kvstore_t* me, fsm_kvstore_cmd_t* cmd)
+{
+    if (FSM_CMD_OP_SET != cmd->type ||
+        cmd->key_len < 1 || FSM_KVSTORE_KEY_MAX < cmd->key_len ||
+        cmd->value_len < 0 || FSM_KVSTORE_VALUE_MAX < cmd->value_len)
+        return -1;
+    fsm_kvstore_push(me, cmd);
+    return 0;
+}
+
+void fsm_kvstore_snapshot_free(fsm_kvstore_snapshot_t* me)
+{
+    fsm_kvstore_t* store = me->store;
+    int i;
+
+    /* the snapshot's own pages are the ones the store no longer uses */
+    for (i = 0; i < me->n_pages; i++)
+        if (!(i < store->n_slots / PAGE && store->pages[i] == me->pages[i]))
+            free(me->pages[i]);
+    for (i = 0; i < me->n_retired; i++)
+        free(me->retired[i]);
+    free(me->retired);
+    free(me->pages);
+    store->snapshot = NULL;
+    free(me);
+}
+
+static fsm_t __new(fsm_config_t* config)
+{
+    return fsm_kvstore_new(config->key_space, config->value_size,
+                           config->value_dist);
+}
+
+static fsm_t __new_heavy(fsm_config_t* config)
+{
+    fsm_kvstore_t* me = __new(config);
+    me->rounds = FSM_HEAVY_ROUNDS;
+    return me;
+}
+
+static void __free(fsm_t me)
+{
+    fsm_kvstore_free(me);
+}
+
+static void __push(fsm_t me, void* cmd)
+{
+    fsm_kvstore_push(me, cmd);
+}
+
+static void __push_batch(fsm_t me, void** cmds, int n)
+{
+    int i;
+    for (i = 0; i < n; i++)
+        fsm_kvstore_push(me, cmds[i]);
+}
+
+static void* __cmd(fsm_t me, int key)
+{
+    return fsm_kvstore_cmd(me, key);
 }
 
-/* void fsm_kvstore_snapshot(fsm_kvstore_t* me, char** out, int *len) */
-/* { */
-/*     *len = sizeof(int) * me->size */
-/*     *out = malloc(*len); */
-/*     memcpy(*out, me->cells, *len); */
-/* } */
+static int __cmd_size(void* cmd_)
+{
+    fsm_kvstore_cmd_t* cmd = cmd_;
+    if (cmd->key_len < 1 || FSM_KVSTORE_KEY_MAX < cmd->key_len ||
+        cmd->value_len < 0 || FSM_KVSTORE_VALUE_MAX < cmd->value_len)
+        return -1;
+    return fsm_kvstore_cmd_size(cmd);
+}
+
+static int __key(fsm_t me, int n, char* key)
+{
+    return fsm_kvstore_key(me, n, key);
+}
+
+static void __read(fsm_t me, const char* key, int key_len)
+{
+    int value_len;
+    fsm_kvstore_get(me, key, key_len, &value_len);
+}
+
+static uint64_t __digest_of(fsm_t me)
+{
+    return fsm_kvstore_digest(me);
+}
+
+static void __size(fsm_t me, int* n_keys, long* bytes)
+{
+    *n_keys = ((fsm_kvstore_t*)me)->n_keys;
+    *bytes = ((fsm_kvstore_t*)me)->bytes;
+}
+
+static fsm_snapshot_t* __snapshot(fsm_t me)
+{
+    return (fsm_snapshot_t*)fsm_kvstore_snapshot(me);
+}
+
+static int __snapshot_read(fsm_snapshot_t* snap, char* buf, int size)
+{
+    return fsm_kvstore_snapshot_read((fsm_kvstore_snapshot_t*)snap, buf, size);
+}
+
+static void __snapshot_free(fsm_snapshot_t* snap)
+{
+    fsm_kvstore_snapshot_free((fsm_kvstore_snapshot_t*)snap);
+}
+
+static int __restore(fsm_t me, void* cmd)
+{
+    return fsm_kvstore_restore(me, cmd);
+}
+
+fsm_ops_t fsm_kvstore_ops = {
+    .name               = "kvstore",
+    .cmd_header_size    = sizeof(fsm_kvstore_cmd_t),
+    .cmd_max_size       = sizeof(fsm_kvstore_cmd_t) + FSM_KVSTORE_KEY_MAX +
+                          FSM_KVSTORE_VALUE_MAX,
+    .new                = __new,
+    .free               = __free,
+    .push               = __push,
+    .push_batch         = __push_batch,
+    .cmd                = __cmd,
+    .cmd_size           = __cmd_size,
+    .key                = __key,
+    .read               = __read,
+    .digest             = __digest_of,
+    .size               = __size,
+    .snapshot           = __snapshot,
+    .snapshot_read      = __snapshot_read,
+    .snapshot_free      = __snapshot_free,
+    .restore            = __restore,
+};
+
+fsm_ops_t fsm_heavy_ops = {
+    .name               = "heavy",
+    .cmd_header_size    = sizeof(fsm_kvstore_cmd_t),
+    .cmd_max_size       = sizeof(fsm_kvstore_cmd_t) + FSM_KVSTORE_KEY_MAX +
+                          FSM_KVSTORE_VALUE_MAX,
+    .new                = __new_heavy,
+    .free               = __free,
+    .push               = __push,
+    .push_batch         = __push_batch,
+    .cmd                = __cmd,
+    .cmd_size           = __cmd_size,
+    .key                = __key,
+    .read               = __read,
+    .digest             = __digest_of,
+    .size               = __size,
+    .snapshot           = __snapshot,
+    .snapshot_read      = __snapshot_read,
+    .snapshot_free      = __snapshot_free,
+    .restore            = __restore,
+};
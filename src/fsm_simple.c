@@ -1,6 +1,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <assert.h>
 
 #include "fsm.h"
 
@@ -8,6 +9,8 @@ enum {
     FSM_CMD_OP,
     FSM_CMD_OP_INVERSE,
     FSM_CMD_OP_NUM,
+    /* only in snapshots, so random commands don't make it */
+    FSM_CMD_SET = FSM_CMD_OP_NUM,
 };
 
 /* A function that maps between f: X -> X can be used to create a
@@ -20,16 +23,48 @@ int mapping[] = {
     2,
 };
 
+/* commands fsm_simple_ops.push_batch() applies at a time */
+#define BATCH_SIZE 1024
+
+/* commands per vector, at most; batches are padded to a multiple of it so
+ * that the loops over them run whole vectors, which gcc's -O2 cost model
+ * needs before it'll vectorize them */
+#define LANES 8
+
+#define PADDED(n) (((n) + LANES - 1) & ~(LANES - 1))
+
+/* mixes in the cell's position, so that swapping two cells changes the sum */
+static uint64_t __digest(int cell, int value)
+{
+    uint64_t h = ((uint64_t)cell << 32 | (unsigned int)value) *
+                 UINT64_C(0x9e3779b97f4a7c15);
+    return h ^ (h >> 29);
+}
+
 fsm_simple_t* fsm_simple_new(int size)
 {
+    int i;
     fsm_simple_t* me = calloc(1, sizeof(fsm_simple_t));
     me->size = size;
     me->cells = calloc(me->size, sizeof(int));
+    for (i = 0; i < me->size; i++)
+        me->digest += __digest(i, 0);
     return me;
 }
 
+void fsm_simple_free(fsm_simple_t* me)
+{
+    if (me->snapshot)
+        fsm_simple_snapshot_free(me->snapshot);
+    if (me->batch)
+        fsm_simple_batch_free(me->batch);
+    free(me->cells);
+    free(me);
+}
+
 void fsm_simple_push(fsm_simple_t* me, fsm_simple_cmd_t* cmd)
 {
+    me->digest -= __digest(cmd->cell, me->cells[cmd->cell]);
     switch (cmd->type) {
         case FSM_CMD_OP:
             me->cells[cmd->cell] += mapping[cmd->value];
@@ -37,14 +72,91 @@ void fsm_simple_push(fsm_simple_t* me, fsm_simple_cmd_t* cmd)
         case FSM_CMD_OP_INVERSE:
             me->cells[cmd->cell] -= mapping[cmd->value];
             break;
+        case FSM_CMD_SET:
+            me->cells[cmd->cell] = cmd->value;
+            break;
     }
+    me->digest += __digest(cmd->cell, me->cells[cmd->cell]);
 }
 
-void fsm_simple_rand_cmd(fsm_simple_t* me, fsm_simple_cmd_t* cmd)
+/**
+ * What each command does to its cell. A SET keeps none of the cell and adds
+ * its value; an OP keeps all of it and adds, or takes away, the mapping of
+ * its value. The mapping is picked with compares rather than looked up, as
+ * SSE2 has no gather, so the loop vectorizes at -O2. */
+static void __effects(int n, const int* restrict type,
+                      const int* restrict value, int* restrict keep,
+                      int* restrict add)
+{
+    int m0 = mapping[0], m1 = mapping[1], m2 = mapping[2],
+        m3 = mapping[3], m4 = mapping[4];
+    int i;
+
+    for (i = 0; i < n; i++)
+    {
+        int v = value[i];
+        int k = -(FSM_CMD_SET != type[i]);
+        int neg = -(FSM_CMD_OP_INVERSE == type[i]);
+        int m = (-(0 == v) & m0) | (-(1 == v) & m1) | (-(2 == v) & m2) |
+                (-(3 == v) & m3) | (-(4 == v) & m4);
+        keep[i] = k;
+        add[i] = (((m ^ neg) - neg) & k) | (v & ~k);
+    }
+}
+
+/**
+ * A cell hit twice is taken out and put back twice, which adds up to the
+ * same as fsm_simple_push() does. Vectorizes at -O3; at -O2 gcc won't
+ * emulate the 64 bit multiplies with SSE2.
+ * @return how much the digest changes by */
+static uint64_t __digests(int n, const int* restrict cell,
+                          const int* restrict before,
+                          const int* restrict after)
+{
+    uint64_t digest = 0;
+    int i;
+
+    for (i = 0; i < n; i++)
+        digest += __digest(cell[i], after[i]) - __digest(cell[i], before[i]);
+    return digest;
+}
+
+void fsm_simple_push_batch(fsm_simple_t* me, fsm_simple_batch_t* b)
+{
+    int* cells = me->cells;
+    int i, n = b->n;
+
+    __effects(PADDED(n), b->type, b->value, b->keep, b->add);
+
+    /* Commands can hit the same cell, so they're scattered one at a time */
+    for (i = 0; i < n; i++)
+    {
+        int c = b->cell[i];
+        b->before[i] = cells[c];
+        cells[c] = (cells[c] & b->keep[i]) + b->add[i];
+        b->after[i] = cells[c];
+    }
+
+    /* the padding doesn't change its cells */
+    for (; i < PADDED(n); i++)
+    {
+        b->before[i] = 0;
+        b->after[i] = 0;
+    }
+
+    me->digest += __digests(PADDED(n), b->cell, b->before, b->after);
+}
+
+void fsm_simple_cmd(fsm_simple_t* me, int cell, fsm_simple_cmd_t* cmd)
 {
     cmd->type = random() % FSM_CMD_OP_NUM;
     cmd->value = random() % (sizeof(mapping) / sizeof(*mapping));
-    cmd->cell = random() % me->size;
+    cmd->cell = cell;
+}
+
+void fsm_simple_rand_cmd(fsm_simple_t* me, fsm_simple_cmd_t* cmd)
+{
+    fsm_simple_cmd(me, random() % me->size, cmd);
 }
 
 int fsm_simple_cmp(fsm_simple_t* me, fsm_simple_t* other)
@@ -53,3 +165,226 @@ int fsm_simple_cmp(fsm_simple_t* me, fsm_simple_t* other)
         return me->size - other->size;
     return memcmp(me->cells, other->cells, sizeof(int) * me->size);
 }
+
+uint64_t fsm_simple_digest(fsm_simple_t* me)
+{
+    return me->digest;
+}
+
+fsm_simple_snapshot_t* fsm_simple_snapshot(fsm_simple_t* me)
+{
+    if (me->snapshot)
+        return NULL;
+
+    fsm_simple_snapshot_t* snap = calloc(1, sizeof(*snap));
+    snap->fsm = me;
+    snap->size = me->size;
+    snap->cells = malloc(me->size * sizeof(int));
+    memcpy(snap->cells, me->cells, me->size * sizeof(int));
+    snap->base.size = (int64_t)me->size * sizeof(fsm_simple_cmd_t);
+    snap->base.digest = me->digest;
+    me->snapshot = snap;
+    return snap;
+}
+
+int fsm_simple_snapshot_read(fsm_simple_snapshot_t* me, char* buf, int size)
+{
+    int n = 0;
+
+    while (n < size && me->cell < me->size)
+    {
+        fsm_simple_cmd_t cmd = {
+            .type = FSM_CMD_SET,
+            .cell = me->cell,
+            .value = me->cells[me->cell]
+        };
+
+        if (0 == me->offset)
+            me->base.read_digest += __digest(cmd.cell, cmd.value);
+
+        int k = sizeof(cmd) - me->offset;
+        if (size - n < k)
+            k = size - n;
+        memcpy(buf + n, (char*)&cmd + me->offset, k);
+        n += k;
+        me->offset += k;
+
+        if (me->offset == sizeof(cmd))
+        {
+            me->offset = 0;
+            me->cell += 1;
+        }
+    }
+
+    return n;
+}
+
+int fsm_simple_restore(fsm_simple_t* me, fsm_simple_cmd_t* cmd)
+{
+    if (FSM_CMD_SET != cmd->type || cmd->cell < 0 || me->size <= cmd->cell)
+        return -1;
+    fsm_simple_push(me, cmd);
+    return 0;
+}
+
+void fsm_simple_snapshot_free(fsm_simple_snapshot_t* me)
+{
+    me->fsm->snapshot = NULL;
+    free(me->cells);
+    free(me);
+}
+
+fsm_simple_batch_t* fsm_simple_batch_new(int size)
+{
+    fsm_simple_batch_t* me = calloc(1, sizeof(*me));
+    me->size = size;
+    me->type = calloc(PADDED(size), sizeof(int));
+    me->cell = calloc(PADDED(size), sizeof(int));
+    me->value = calloc(PADDED(size), sizeof(int));
+    me->add = calloc(PADDED(size), sizeof(int));
+    me->keep = calloc(PADDED(size), sizeof(int));
+    me->before = calloc(PADDED(size), sizeof(int));
+    me->after = calloc(PADDED(size), sizeof(int));
+    return me;
+}
+
+void fsm_simple_batch_free(fsm_simple_batch_t* me)
+{
+    free(me->type);
+    free(me->cell);
+    free(me->value);
+    free(me->add);
+    free(me->keep);
+    free(me->before);
+    free(me->after);
+    free(me);
+}
+
+int fsm_simple_batch_add(fsm_simple_batch_t* me, fsm_simple_cmd_t* cmd)
+{
+    if (me->n == me->size)
+        return -1;
+    me->type[me->n] = cmd->type;
+    me->cell[me->n] = cmd->cell;
+    me->value[me->n] = cmd->value;
+    me->n += 1;
+    return 0;
+}
+
+static fsm_t __new(fsm_config_t* config)
+{
+    return fsm_simple_new(config->key_space);
+}
+
+static void __free(fsm_t me)
+{
+    fsm_simple_free(me);
+}
+
+static void __push(fsm_t me, void* cmd)
+{
+    fsm_simple_push(me, cmd);
+}
+
+/* gathers the commands into a fsm_simple_batch_t a BATCH_SIZE at a time */
+static void __push_batch(fsm_t me_, void** cmds, int n)
+{
+    fsm_simple_t* me = me_;
+    fsm_simple_batch_t* b = me->batch;
+    int i, j;
+
+    if (!b)
+        b = me->batch = fsm_simple_batch_new(BATCH_SIZE);
+
+    for (i = 0; i < n; i += b->n)
+    {
+        b->n = n - i < b->size ? n - i : b->size;
+        for (j = 0; j < b->n; j++)
+        {
+            fsm_simple_cmd_t* cmd = cmds[i + j];
+            b->type[j] = cmd->type;
+            b->cell[j] = cmd->cell;
+            b->value[j] = cmd->value;
+        }
+        fsm_simple_push_batch(me, b);
+    }
+}
+
+static void* __cmd(fsm_t me, int key)
+{
+    fsm_simple_cmd_t* cmd = malloc(sizeof(*cmd));
+    fsm_simple_cmd(me, key, cmd);
+    return cmd;
+}
+
+static int __cmd_size(void* cmd)
+{
+    return sizeof(fsm_simple_cmd_t);
+}
+
+/* the key is the cell's number */
+static int __key(fsm_t me, int n, char* key)
+{
+    memcpy(key, &n, sizeof(n));
+    return sizeof(n);
+}
+
+static void __read(fsm_t me_, const char* key, int key_len)
+{
+    fsm_simple_t* me = me_;
+    int cell;
+
+    memcpy(&cell, key, sizeof(cell));
+    assert(sizeof(cell) == key_len && 0 <= cell && cell < me->size);
+}
+
+static uint64_t __digest_of(fsm_t me)
+{
+    return fsm_simple_digest(me);
+}
+
+static void __size(fsm_t me, int* n_keys, long* bytes)
+{
+    *n_keys = ((fsm_simple_t*)me)->size;
+    *bytes = (long)*n_keys * sizeof(int);
+}
+
+static fsm_snapshot_t* __snapshot(fsm_t me)
+{
+    return (fsm_snapshot_t*)fsm_simple_snapshot(me);
+}
+
+static int __snapshot_read(fsm_snapshot_t* snap, char* buf, int size)
+{
+    return fsm_simple_snapshot_read((fsm_simple_snapshot_t*)snap, buf, size);
+}
+
+static void __snapshot_free(fsm_snapshot_t* snap)
+{
+    fsm_simple_snapshot_free((fsm_simple_snapshot_t*)snap);
+}
+
+static int __restore(fsm_t me, void* cmd)
+{
+    return fsm_simple_restore(me, cmd);
+}
+
+fsm_ops_t fsm_simple_ops = {
+    .name               = "simple",
+    .cmd_header_size    = sizeof(fsm_simple_cmd_t),
+    .cmd_max_size       = sizeof(fsm_simple_cmd_t),
+    .new                = __new,
+    .free               = __free,
+    .push               = __push,
+    .push_batch         = __push_batch,
+    .cmd                = __cmd,
+    .cmd_size           = __cmd_size,
+    .key                = __key,
+    .read               = __read,
+    .digest             = __digest_of,
+    .size               = __size,
+    .snapshot           = __snapshot,
+    .snapshot_read      = __snapshot_read,
+    .snapshot_free      = __snapshot_free,
+    .restore            = __restore,
+};
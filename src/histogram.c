@@ -0,0 +1,77 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "histogram.h"
+
+static int __bucket(int value)
+{
+    if (value < HISTOGRAM_SUB_BUCKETS)
+        return value;
+
+    /* the highest set bit picks the power of two range; the bits below it
+     * pick one of HISTOGRAM_SUB_BUCKETS linear sub-buckets in that range */
+    int shift = 31 - __builtin_clz(value) - HISTOGRAM_SUB_BUCKET_BITS;
+    return shift * HISTOGRAM_SUB_BUCKETS + (value >> shift);
+}
+
+/** @return the highest value that falls within this bucket */
+static int __bucket_value(int bucket)
+{
+    if (bucket < 2 * HISTOGRAM_SUB_BUCKETS)
+        return bucket;
+
+    int shift = bucket / HISTOGRAM_SUB_BUCKETS - 1;
+    long sub = bucket - shift * HISTOGRAM_SUB_BUCKETS;
+    return (int)(((sub + 1) << shift) - 1);
+}
+
+histogram_t* histogram_new()
+{
+    return calloc(1, sizeof(histogram_t));
+}
+
+void histogram_free(histogram_t* me)
+{
+    free(me);
+}
+
+void histogram_clear(histogram_t* me)
+{
+    memset(me, 0, sizeof(*me));
+}
+
+void histogram_record(histogram_t* me, int value)
+{
+    if (value < 0)
+        value = 0;
+    me->counts[__bucket(value)] += 1;
+    me->count += 1;
+    if (me->max < value)
+        me->max = value;
+}
+
+int histogram_percentile(histogram_t* me, double pct)
+{
+    int i;
+    long seen = 0;
+
+    if (0 == me->count)
+        return 0;
+
+    /* rank of the value we're after, counting from 1 */
+    long rank = (long)(pct / 100.0 * me->count + 0.5);
+    if (rank < 1)
+        rank = 1;
+
+    for (i = 0; i < HISTOGRAM_BUCKETS; i++)
+    {
+        seen += me->counts[i];
+        if (rank <= seen)
+        {
+            int v = __bucket_value(i);
+            return v < me->max ? v : me->max;
+        }
+    }
+
+    return me->max;
+}
@@ -9,8 +9,13 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <fcntl.h>
+#include <inttypes.h>
 
 #include "fsm.h"
+#include "snapshot.h"
+#include "histogram.h"
+#include "trace.h"
+#include "workload.h"
 #include "raft.h"
 #include "linked_list_queue.h"
 #include "fixed_arraylist.h"
@@ -21,7 +26,13 @@
 #define RAFT_BUFLEN 512
 #define len(x) (sizeof((x)) / sizeof((x)[0]))
 
-#define FSM_SIZE 32
+
+/* raft_periodic() is handed random() % 100 msec each iteration, so on
+ * average an iteration is worth this much virtual time */
+#define MSEC_PER_ITER 50
+
+/* client entries waiting for a leader; new ones are dropped beyond this */
+#define PROPOSALS_MAX 1024
 
 enum {
     NODE_DISCONNECTED,
@@ -44,8 +55,21 @@ typedef enum
     MSG_REQUESTVOTE_RESPONSE,
     MSG_APPENDENTRIES,
     MSG_APPENDENTRIES_RESPONSE,
+    MSG_PREVOTE,
+    MSG_PREVOTE_RESPONSE,
+    MSG_TIMEOUTNOW,
 } peer_message_type_e;
 
+static const char* msg_names[] = {
+    "requestvote",
+    "requestvote_response",
+    "appendentries",
+    "appendentries_response",
+    "prevote",
+    "prevote_response",
+    "timeoutnow",
+};
+
 typedef struct
 {
     int type;
@@ -54,8 +78,54 @@ typedef struct
 
     /* node ID of sender */
     int sender;
+
+    /* raft group the message belongs to, see --groups */
+    int group;
+
+    /* unique ID for tracing */
+    int id;
 } msg_t;
 
+/** A snapshot as saved to a server's disk, which is simulated in memory */
+typedef struct
+{
+    char* data;
+    long len;
+    long size;
+
+    /* transfers sending it hold a reference too */
+    int refs;
+} snapshot_file_t;
+
+/** Snapshot being sent to a server that needs entries compacted out of the
+ * sender's log */
+typedef struct
+{
+    snapshot_file_t* file;
+
+    /* bytes of file sent */
+    long offset;
+
+    /* node ID of the sender */
+    int sender;
+
+    /* the state machine the snapshot is installed into */
+    fsm_t fsm;
+    snapshot_reader_t* reader;
+
+    /* iteration the transfer started */
+    int started;
+} snapshot_transfer_t;
+
+/** Extra raft group run by a server, see --groups */
+typedef struct
+{
+    raft_server_t* raft;
+
+    /* the primary group is 0 */
+    int idx;
+} group_t;
+
 typedef struct
 {
     /* the server's node ID */
@@ -63,29 +133,124 @@ typedef struct
 
     raft_server_t* raft;
 
+    /* extra raft groups, indexed by group; entry 0 is unused because the
+     * primary group is raft */
+    group_t* groups;
+
     /* messages we want to receive */
     void* inbox;
 
+    /* messages to each server waiting to be sent as one packet, see
+     * --coalesce */
+    void** outboxes;
+
     /* whether or not this node can communicate with other servers */
     int partitioned;
 
+    /* how fast this server's clock runs, in percent of real time */
+    int clock_rate;
+
     int connect_status;
 
+    /* waiting to be swapped out, or in once it caught up, by the next joint
+     * configuration change, see --joint */
+    int leaving;
+    int caught_up;
+
+    /* iteration it started catching up as a non-voting server, or -1 */
+    int joined_at;
+
     int total_offer_count;
 
-    fsm_kvstore_t* fsm;
+    fsm_t fsm;
+
+    /* idx and iteration of the snapshot being serialized, see
+     * --snapshot_every */
+    int snapshot_idx;
+    int snapshot_started;
+
+    /* serializes the snapshot being taken into snapshot_saving */
+    snapshot_writer_t* snapshot_writer;
+    snapshot_file_t* snapshot_saving;
+
+    /* the last snapshot saved or installed; what the log was compacted to */
+    snapshot_file_t* snapshot_file;
+
+    /* snapshot being received, or NULL */
+    snapshot_transfer_t* snapshot_recv;
+
+    /* last state and commit idx written to the trace */
+    int trace_state;
+    int trace_commit_idx;
 } server_t;
 
 typedef struct {
     int node_id;
 } entry_cfg_change_t;
 
+/** Client read, see raft_read_request() */
+typedef struct {
+    /* iteration the read was requested */
+    int offered;
+
+    char key[FSM_KVSTORE_KEY_MAX];
+    int key_len;
+
+    /* highest idx any server had applied when the read was requested; the
+     * read must observe at least this */
+    int min_applied_idx;
+} read_t;
+
+/** Client entry waiting to be accepted by a leader */
+typedef struct {
+    void* cmd;
+
+    /* iteration the client proposed the entry */
+    int offered;
+} proposal_t;
+
+/** Lifecycle of a client entry, indexed by raft_entry_t.id */
+typedef struct {
+    /* iteration the client proposed the entry */
+    int offered;
+
+    /* number of connected servers that have applied the entry */
+    int applied;
+
+    /* set once the entry has been applied by every connected server */
+    int applied_by_all;
+} entry_stat_t;
+
+typedef struct
+{
+    FILE* out;
+
+    /* number of iterations between rows */
+    int interval;
+
+    /* totals at the time of the previous row */
+    int commits;
+    int ae_count;
+    int ae_entries;
+    int leadership_changes;
+
+    /* max number of entries in an appendentries message this interval */
+    int ae_max;
+
+    /* latencies within this interval */
+    histogram_t* commit_latency;
+    histogram_t* apply_latency;
+} metrics_t;
+
 typedef struct
 {
     server_t* servers;
     int n_servers;
     int n_entries;
 
+    /* number of times __periodic() has run */
+    int iters;
+
     raft_node_t* leader;
 
     /* stat: max number of entries spotted in an appendentries message */
@@ -94,19 +259,136 @@ typedef struct
     /* stat: number of leadership changes */
     int leadership_changes;
 
+    /* stat: number of leadership transfers started */
+    int n_transfers;
+
+    /* stat: number of entries applied by at least one server */
+    int n_commits;
+
+    /* stat: number of appendentries messages sent, and entries within them */
+    int ae_count;
+    int ae_entries;
+
+    /* stat: bytes of entry data sent in appendentries messages */
+    long ae_bytes;
+
+    /* stat: the part of ae_bytes sent to non-voting servers */
+    long learner_bytes;
+
+    /* stat: virtual msec from adding a non-voting server until it caught up */
+    histogram_t* catchup_latency;
+
+    /* entries applied between snapshots, or 0 for none */
+    int snapshot_every;
+
+    /* bytes a server serializes per iteration */
+    int snapshot_bytes_per_iter;
+
+    /* stat: snapshots taken, and those skipped because the last one was
+     * still being serialized */
+    int n_snapshots;
+    int n_snapshots_skipped;
+
+    /* stat: pages servers copied while a snapshot shared them */
+    long snapshot_pages_copied;
+
+    /* stat: virtual msec from taking a snapshot until it was serialized */
+    histogram_t* snapshot_latency;
+
+    /* stat: snapshots sent to servers missing compacted entries, those
+     * installed, and the bytes sent */
+    int n_snapshot_transfers;
+    int n_snapshots_installed;
+    long snapshot_bytes_sent;
+
+    /* stat: virtual msec from starting to send a snapshot until it was
+     * installed */
+    histogram_t* install_latency;
+
+    /* number of NODE_CONNECTED servers */
+    int n_connected;
+
+    entry_stat_t* entry_stats;
+    int entry_stats_size;
+
+    /* digest of the state machine after applying each idx, as seen by the
+     * first server to apply it; 0 if nothing has been recorded yet */
+    uint64_t* digests;
+    int digests_size;
+
+    /* stat: virtual msec from offering an entry until it's first applied
+     * (ie. committed on a majority), and until every connected server
+     * applied it */
+    histogram_t* commit_latency;
+    histogram_t* apply_latency;
+
     int log_pops;
 
     int num_unique_nodes;
     int num_membership_changes;
 
-    int client_rate;
+    /* joint configuration changes, and the most servers one swapped */
+    int n_joint_changes;
+    int max_joint_size;
+
+    /* what clients write and read, and when */
+    workload_t* workload;
+
+    /* client entries not yet accepted by a leader, oldest first */
+    proposal_t* proposals;
+    int n_proposals;
+
+    /* stat: entries dropped because the proposal queue was full */
+    int n_proposals_dropped;
+
+    /* every server is handed the same period each iteration, scaled by its
+     * clock_rate */
+    int shared_clock;
 
     int membership_rate;
 
+    /* highest idx applied by any server */
+    int max_applied_idx;
+
+    /* stat: reads served, and reads that failed because of a leadership
+     * change */
+    int n_reads;
+    int n_reads_failed;
+
+    /* stat: virtual msec from requesting a read until it's safe */
+    histogram_t* read_latency;
+
     farraylist_t* commits;
 
+    /* data of the entries leaders appended, which is shared by every log
+     * they're replicated to, so it's only freed with the system */
+    void* entry_bufs;
+
     /* the master finite state machine */
-    fsm_kvstore_t* fsm;
+    fsm_t fsm;
+
+    /* the state machine every server runs, see --fsm */
+    fsm_ops_t* fsm_ops;
+    fsm_config_t fsm_config;
+
+    /* stat: commands servers applied; bench_fsm measures how fast */
+    long n_applied;
+
+    metrics_t metrics;
+
+    trace_t* trace;
+
+    /* orders trace events within an iteration */
+    int trace_seq;
+
+    /* number of messages sent */
+    int n_msgs;
+
+    /* number of packets sent; one per message unless coalescing */
+    int n_packets;
+
+    /* raft groups per server */
+    int n_groups;
 } system_t;
 
 system_t sys;
@@ -178,10 +460,347 @@ static void __print_stats()
     }
 }
 
+/** Vote requests ignored because the receiver still followed a live leader */
+static int __suppressed_votes(system_t* sys)
+{
+    int i, votes = 0;
+
+    for (i = 0; i < sys->n_servers; i++)
+        votes += raft_get_suppressed_votes(sys->servers[i].raft);
+    return votes;
+}
+
+/** Extra groups whose leader is recognised by every server */
+static int __groups_with_leader(system_t* sys)
+{
+    int g, i, n = 0;
+
+    for (g = 1; g < sys->n_groups; g++)
+    {
+        int leader = raft_get_current_leader(sys->servers[0].groups[g].raft);
+        for (i = 0; i < sys->n_servers; i++)
+            if (-1 == leader ||
+                leader != raft_get_current_leader(sys->servers[i].groups[g].raft))
+                break;
+        if (i == sys->n_servers)
+            n += 1;
+    }
+    return n;
+}
+
+/** Times a leader stepped down because a majority stopped responding */
+static int __quorum_step_downs(system_t* sys)
+{
+    int i, step_downs = 0;
+
+    for (i = 0; i < sys->n_servers; i++)
+        step_downs += raft_get_quorum_step_downs(sys->servers[i].raft);
+    return step_downs;
+}
+
+static void __metrics_header(system_t* sys)
+{
+    FILE* out = sys->metrics.out;
+    int i;
+
+    fprintf(out, "iters\t");
+    fprintf(out, "time_ms\t");
+    fprintf(out, "commits\t");
+    fprintf(out, "commits_per_sec\t");
+    fprintf(out, "ae_count\t");
+    fprintf(out, "ae_avg_entries\t");
+    fprintf(out, "ae_max_entries\t");
+    fprintf(out, "inbox_total\t");
+    fprintf(out, "inbox_max\t");
+    fprintf(out, "leadership_changes\t");
+    fprintf(out, "commit_p50_ms\t");
+    fprintf(out, "commit_p99_ms\t");
+    fprintf(out, "commit_p999_ms\t");
+    fprintf(out, "commit_max_ms\t");
+    fprintf(out, "apply_all_p99_ms\t");
+    fprintf(out, "apply_all_max_ms");
+    for (i = 0; i < sys->n_servers; i++)
+        fprintf(out, "\tlog_count_%d", i);
+    fprintf(out, "\n");
+}
+
+/** Write one row of metrics covering the iterations since the last row */
+static void __metrics_row(system_t* sys)
+{
+    metrics_t* m = &sys->metrics;
+    FILE* out = m->out;
+    int i, inbox_total = 0, inbox_max = 0;
+
+    for (i = 0; i < sys->n_servers; i++)
+    {
+        int n = llqueue_count(sys->servers[i].inbox);
+        inbox_total += n;
+        if (inbox_max < n)
+            inbox_max = n;
+    }
+
+    int commits = sys->n_commits - m->commits;
+    int ae_count = sys->ae_count - m->ae_count;
+    int ae_entries = sys->ae_entries - m->ae_entries;
+
+    fprintf(out, "%d\t%d\t%d\t%.1f\t%d\t%.2f\t%d\t%d\t%d\t%d",
+            sys->iters,
+            sys->iters * MSEC_PER_ITER,
+            commits,
+            commits * 1000.0 / (m->interval * MSEC_PER_ITER),
+            ae_count,
+            ae_count ? (double)ae_entries / ae_count : 0.0,
+            m->ae_max,
+            inbox_total,
+            inbox_max,
+            sys->leadership_changes - m->leadership_changes);
+    fprintf(out, "\t%d\t%d\t%d\t%d\t%d\t%d",
+            histogram_percentile(m->commit_latency, 50),
+            histogram_percentile(m->commit_latency, 99),
+            histogram_percentile(m->commit_latency, 99.9),
+            m->commit_latency->max,
+            histogram_percentile(m->apply_latency, 99),
+            m->apply_latency->max);
+    for (i = 0; i < sys->n_servers; i++)
+        fprintf(out, "\t%d", raft_get_log_count(sys->servers[i].raft));
+    fprintf(out, "\n");
+
+    m->commits = sys->n_commits;
+    m->ae_count = sys->ae_count;
+    m->ae_entries = sys->ae_entries;
+    m->leadership_changes = sys->leadership_changes;
+    m->ae_max = 0;
+    histogram_clear(m->commit_latency);
+    histogram_clear(m->apply_latency);
+}
+
+static void __print_latency(const char* name, histogram_t* h)
+{
+    printf("%s latency (ms): p50 %d p99 %d p999 %d max %d (n=%ld)\n",
+           name,
+           histogram_percentile(h, 50),
+           histogram_percentile(h, 99),
+           histogram_percentile(h, 99.9),
+           h->max,
+           h->count);
+}
+
+static entry_stat_t* __get_entry_stat(system_t* sys, int id)
+{
+    if (sys->entry_stats_size <= id)
+    {
+        int size = sys->entry_stats_size ? sys->entry_stats_size : 1024;
+        while (size <= id)
+            size *= 2;
+        sys->entry_stats = realloc(sys->entry_stats, size * sizeof(entry_stat_t));
+        memset(&sys->entry_stats[sys->entry_stats_size], 0,
+               (size - sys->entry_stats_size) * sizeof(entry_stat_t));
+        sys->entry_stats_size = size;
+    }
+    return &sys->entry_stats[id];
+}
+
+static void __record_latency(system_t* sys, histogram_t* h, histogram_t* interval, int offered)
+{
+    int msec = (sys->iters - offered) * MSEC_PER_ITER;
+    histogram_record(h, msec);
+    if (interval)
+        histogram_record(interval, msec);
+}
+
+/** State Machine Safety, in O(1) however big the state machine is:
+ * every server has the same state after applying the same idx */
+static void __check_digest(system_t* sys, server_t* sv, int idx)
+{
+    uint64_t digest = sys->fsm_ops->digest(sv->fsm);
+
+    /* 0 means unrecorded, and an empty store's digest is 0 too */
+    digest |= 1;
+
+    if (sys->digests_size <= idx)
+    {
+        int size = sys->digests_size ? sys->digests_size : 1024;
+        while (size <= idx)
+            size *= 2;
+        sys->digests = realloc(sys->digests, size * sizeof(uint64_t));
+        memset(&sys->digests[sys->digests_size], 0,
+               (size - sys->digests_size) * sizeof(uint64_t));
+        sys->digests_size = size;
+    }
+
+    if (0 == sys->digests[idx])
+        sys->digests[idx] = digest;
+    else if (sys->digests[idx] != digest)
+    {
+        printf("node %d's state machine diverged at idx:%d "
+               "(digest %" PRIx64 " vs %" PRIx64 ")\n",
+               sv->node_id, idx + 1, digest, sys->digests[idx]);
+        __print_stats();
+        abort();
+    }
+}
+
+static void __unref_snapshot_file(snapshot_file_t* file)
+{
+    if (!file || 0 < --file->refs)
+        return;
+    free(file->data);
+    free(file);
+}
+
+/** Drop the snapshot being serialized; the log isn't compacted */
+static void __abandon_snapshot(server_t* sv)
+{
+    if (!sv->snapshot_writer)
+        return;
+    sys.fsm_ops->snapshot_free(sv->snapshot_writer->fsm);
+    snapshot_writer_free(sv->snapshot_writer);
+    sv->snapshot_writer = NULL;
+    __unref_snapshot_file(sv->snapshot_saving);
+    sv->snapshot_saving = NULL;
+}
+
+static void __free_transfer(server_t* sv)
+{
+    snapshot_transfer_t* t = sv->snapshot_recv;
+
+    if (!t)
+        return;
+    __unref_snapshot_file(t->file);
+    snapshot_reader_free(t->reader);
+    if (t->fsm)
+        sys.fsm_ops->free(t->fsm);
+    free(t);
+    sv->snapshot_recv = NULL;
+}
+
+/** Fork the server's state machine; applying carries on while the snapshot
+ * is serialized by __serialize_snapshot() */
+static void __take_snapshot(system_t* sys, server_t* sv, raft_entry_t* ety,
+                            int idx)
+{
+    int i;
+
+    /* the configuration changes with entries not applied yet */
+    if (sv->snapshot_writer || 0 != raft_begin_snapshot(sv->raft))
+    {
+        sys->n_snapshots_skipped += 1;
+        return;
+    }
+
+    fsm_snapshot_t* snap = sys->fsm_ops->snapshot(sv->fsm);
+    assert(snap);
+
+    int n_nodes = raft_get_num_nodes(sv->raft);
+    snapshot_node_t* nodes = calloc(n_nodes + 1, sizeof(snapshot_node_t));
+    for (i = 0; i < n_nodes; i++)
+    {
+        raft_node_t* node = raft_get_node_from_idx(sv->raft, i);
+        nodes[i].id = raft_node_get_id(node);
+        nodes[i].voting = raft_node_is_voting(node);
+        nodes[i].voting_new = raft_node_is_voting_new(node);
+    }
+    sv->snapshot_writer = snapshot_writer_new(sys->fsm_ops, snap, idx + 1,
+                                              ety->term, nodes, n_nodes);
+    free(nodes);
+
+    sv->snapshot_saving = calloc(1, sizeof(snapshot_file_t));
+    sv->snapshot_saving->refs = 1;
+    sv->snapshot_idx = idx;
+    sv->snapshot_started = sys->iters;
+    sys->n_snapshots += 1;
+}
+
+/** Save the next part of the snapshot; once it's all saved, compact the log
+ * up to it */
+static void __serialize_snapshot(system_t* sys, server_t* sv)
+{
+    snapshot_file_t* file = sv->snapshot_saving;
+    int budget = sys->snapshot_bytes_per_iter;
+    int n = 1;
+
+    while (0 < budget && 0 < n)
+    {
+        if (file->size < file->len + budget)
+        {
+            while (file->size < file->len + budget)
+                file->size = file->size ? file->size * 2 : 65536;
+            file->data = realloc(file->data, file->size);
+        }
+        n = snapshot_writer_read(sv->snapshot_writer, file->data + file->len,
+                                 budget);
+        file->len += n;
+        budget -= n;
+    }
+
+    if (0 != n)
+        return;
+
+    /* what was serialized is what the state machine was at the idx */
+    fsm_snapshot_t* snap = sv->snapshot_writer->fsm;
+    if (snap->read_digest != snap->digest)
+    {
+        printf("node %d's snapshot at idx:%d changed while it was serialized "
+               "(digest %" PRIx64 " vs %" PRIx64 ")\n",
+               sv->node_id, sv->snapshot_idx + 1, snap->read_digest,
+               snap->digest);
+        __print_stats();
+        abort();
+    }
+
+    histogram_record(sys->snapshot_latency,
+                     (sys->iters - sv->snapshot_started) * MSEC_PER_ITER);
+    sys->snapshot_pages_copied += snap->pages_copied;
+
+    sys->fsm_ops->snapshot_free(snap);
+    snapshot_writer_free(sv->snapshot_writer);
+    sv->snapshot_writer = NULL;
+    sv->snapshot_saving = NULL;
+
+    /* superseded by a snapshot installed meanwhile */
+    if (0 != raft_end_snapshot(sv->raft))
+    {
+        __unref_snapshot_file(file);
+        return;
+    }
+    __unref_snapshot_file(sv->snapshot_file);
+    sv->snapshot_file = file;
+}
+
+/** Track commit and apply-everywhere latency of a client entry.
+ * Servers that are still catching up (ie. not NODE_CONNECTED) don't count
+ * towards "everywhere", otherwise a new node replaying history would
+ * dominate the numbers. */
+static void __entry_applied(system_t* sys, server_t* sv, raft_entry_t* ety)
+{
+    if (sys->entry_stats_size <= ety->id)
+        return;
+
+    entry_stat_t* st = &sys->entry_stats[ety->id];
+    if (0 == st->applied)
+        __record_latency(sys, sys->commit_latency,
+                         sys->metrics.commit_latency, st->offered);
+
+    if (sv->connect_status != NODE_CONNECTED)
+        return;
+    st->applied += 1;
+
+    if (!st->applied_by_all && sys->n_connected <= st->applied)
+    {
+        st->applied_by_all = 1;
+        __record_latency(sys, sys->apply_latency,
+                         sys->metrics.apply_latency, st->offered);
+    }
+}
+
 static void __set_connect_status(server_t* sv, int new_status)
 {
     assert(!(sv->connect_status == NODE_CONNECTED && new_status == NODE_CONNECTING));
     /* printf("csc: %d %d to %d\n", sv->node_id, sv->connect_status, new_status); */
+    if (sv->connect_status != NODE_CONNECTED && new_status == NODE_CONNECTED)
+        sys.n_connected += 1;
+    else if (sv->connect_status == NODE_CONNECTED && new_status != NODE_CONNECTED)
+        sys.n_connected -= 1;
     sv->connect_status = new_status;
 }
 
@@ -200,6 +819,67 @@ static void __int_handler(int dummy)
     __print_stats();
 }
 
+static void __trace(system_t* sys, int type, server_t* sv, server_t* peer,
+                    int a, int b)
+{
+    if (!sv)
+        return;
+
+    /* spread events within an iteration so their order is kept */
+    unsigned long ts = (unsigned long)sys->iters * MSEC_PER_ITER * 1000 +
+                       sys->trace_seq;
+    if (sys->trace_seq < MSEC_PER_ITER * 1000 - 1)
+        sys->trace_seq++;
+
+    trace_record(sys->trace, ts, type, sv - sys->servers,
+                 peer ? peer - sys->servers : -1, a, b);
+}
+
+/** Raft doesn't tell us about state or commit idx changes, so compare against
+ * what we saw last time */
+static void __trace_server(system_t* sys, server_t* sv)
+{
+    int state = raft_get_state(sv->raft);
+    if (state != sv->trace_state)
+    {
+        __trace(sys, TRACE_STATE, sv, NULL, state, raft_get_current_term(sv->raft));
+        sv->trace_state = state;
+    }
+
+    int commit_idx = raft_get_commit_idx(sv->raft);
+    if (commit_idx != sv->trace_commit_idx)
+    {
+        if (sv->trace_commit_idx < commit_idx)
+            __trace(sys, TRACE_COMMIT, sv, NULL, commit_idx, 0);
+        sv->trace_commit_idx = commit_idx;
+    }
+}
+
+static void __trace_dump(system_t* sys)
+{
+    if (!sys->trace)
+        return;
+
+    FILE* out = fopen(opts.trace, "w");
+    if (!out)
+    {
+        perror(opts.trace);
+        return;
+    }
+    trace_dump_chrome(sys->trace, out, sys->n_servers, msg_names);
+    fclose(out);
+
+    trace_free(sys->trace);
+    sys->trace = NULL;
+}
+
+/** Keep the trace of a run that failed an assertion or safety check */
+static void __abrt_handler(int dummy)
+{
+    __trace_dump(&sys);
+    signal(SIGABRT, SIG_DFL);
+}
+
 static server_t* __get_leader(system_t* sys)
 {
     int i;
@@ -225,6 +905,11 @@ static int __raft_applylog(
 
     system_t* sys = udata;
 
+    if (sys->trace)
+        __trace(sys, TRACE_APPLY,
+                __get_server_from_nodeid(sys, raft_get_nodeid(raft)), NULL,
+                idx, ety->id);
+
     /* Log Matching
     *  If two logs contain an entry with the same index and term, then the
     *  logs are identical in all entries up through the given index.
@@ -233,12 +918,16 @@ static int __raft_applylog(
     *  If a log entry is committed in a given term, then that entry will be
     *  present in the logs of the leaders for all higher-numbered terms. */
 
+    if (sys->max_applied_idx < idx + 1)
+        sys->max_applied_idx = idx + 1;
+
     raft_entry_t* ety_stored = farraylist_get(sys->commits, idx);
     if (!ety_stored)
     {
         ety_stored = calloc(1, sizeof(*ety));
         memcpy(ety_stored, ety, sizeof(*ety));
         farraylist_insert(sys->commits, ety_stored, idx);
+        sys->n_commits += 1;
     }
     else if (ety_stored->id != ety->id)
     {
@@ -264,9 +953,22 @@ static int __raft_applylog(
             break;
 
         case RAFT_LOGTYPE_ADD_NONVOTING_NODE:
+        case RAFT_LOGTYPE_JOINT_DEMOTE_NODE:
+            break;
+
+        case RAFT_LOGTYPE_LEAVE_JOINT:
+            {
+                /* demoted servers stay until the new configuration is in
+                 * effect */
+                raft_node_t* node = raft_get_my_node(raft);
+                if (node && raft_node_is_voting(node) &&
+                    !raft_node_is_voting_new(node))
+                    return RAFT_ERR_SHUTDOWN;
+            }
             break;
 
         case RAFT_LOGTYPE_ADD_NODE:
+        case RAFT_LOGTYPE_JOINT_ADD_NODE:
             {
                 entry_cfg_change_t *chg = (void*)ety->data.buf;
 
@@ -281,7 +983,12 @@ static int __raft_applylog(
         default:
             {
             server_t* sv = __get_server_from_nodeid(sys, raft_get_nodeid(raft));
-            fsm_kvstore_push(sv->fsm, ety->data.buf);
+            sys->fsm_ops->push(sv->fsm, ety->data.buf);
+            sys->n_applied += 1;
+            __check_digest(sys, sv, idx);
+            if (sys->snapshot_every && 0 == (idx + 1) % sys->snapshot_every)
+                __take_snapshot(sys, sv, ety, idx);
+            __entry_applied(sys, sv, ety);
             }
             break;
     }
@@ -341,10 +1048,14 @@ static int __raft_persist_vote(
     return 0;
 }
 
-/** Raft callback for displaying debugging information */
+/** Raft callback for displaying debugging information; events are only
+ * formatted here, as they're printed */
 void __raft_log(raft_server_t* raft, raft_node_t* node, void *udata,
-                const char *buf)
+                const raft_log_event_t* ev)
 {
+    char buf[1024];
+
+    raft_log_event_format(ev, buf, sizeof(buf));
     if (node)
         printf("> %0.10d, %0.10d %s\n",
                raft_get_nodeid(raft),
@@ -370,6 +1081,13 @@ static int __raft_logentry_offer(
     if (server)
         server->total_offer_count += 1;
 
+    /* followers append what a leader already did */
+    if (raft_is_leader(r))
+        llqueue_offer(sys->entry_bufs, ety->data.buf);
+
+    if (sys->trace && server)
+        __trace(sys, TRACE_APPEND, server, NULL, ety_idx, ety->term);
+
     return 0;
 }
 
@@ -402,7 +1120,8 @@ static int __raft_logentry_pop(
 
     sys->log_pops += 1;
 
-    if (!raft_entry_is_cfg_change(ety))
+    if (!raft_entry_is_cfg_change(ety) ||
+        RAFT_LOGTYPE_LEAVE_JOINT == ety->type)
         return 0;
 
     server_t* sv = __get_server_from_nodeid(sys, chg->node_id);
@@ -410,6 +1129,7 @@ static int __raft_logentry_pop(
     switch (ety->type)
     {
         case RAFT_LOGTYPE_DEMOTE_NODE:
+        case RAFT_LOGTYPE_JOINT_DEMOTE_NODE:
             break;
 
         case RAFT_LOGTYPE_REMOVE_NODE:
@@ -423,6 +1143,7 @@ static int __raft_logentry_pop(
             break;
 
         case RAFT_LOGTYPE_ADD_NODE:
+        case RAFT_LOGTYPE_JOINT_ADD_NODE:
             if (chg->node_id == raft_get_nodeid(raft))
             {
                 /* assert(sv->connect_status == NODE_CONNECTING); */
@@ -449,10 +1170,34 @@ static int __raft_logentry_get_node_id(
     return chg->node_id;
 }
 
+static msg_t* __new_msg(system_t* sys, void* data, int type, int len,
+                        int sender, int group)
+{
+    msg_t* m = calloc(1, sizeof(msg_t));
+    m->type = type;
+    m->len = len;
+    m->sender = sender;
+    m->group = group;
+    m->id = sys->n_msgs++;
+    m->data = malloc(len);
+    memcpy(m->data, data, len);
+    if (MSG_APPENDENTRIES == type)
+    {
+        /* every copy owns its entries so that it can be freed on receipt */
+        msg_appendentries_t* ae = m->data;
+        ae->entries = malloc(sizeof(msg_entry_t) * ae->n_entries);
+        memcpy(ae->entries, ((msg_appendentries_t*)data)->entries,
+               sizeof(msg_entry_t) * ae->n_entries);
+    }
+    return m;
+}
+
 /**
  * @param sys The udata of the raft server sending this
  * @param dst_node_id The sending raft server's node it is sending to
  * @param raft The raft server sending this
+ * @param group The raft group of the sending raft server
+ * @return 0, dropped messages look like sent ones to the sender
  */
 static int __append_msg(
     system_t* sys,
@@ -460,35 +1205,51 @@ static int __append_msg(
     int type,
     int len,
     int dst_node_id,
-    raft_server_t* raft
+    raft_server_t* raft,
+    int group
     )
 {
-    /* drop rate */
-    if (random() % 100 < atoi(opts.drop_rate))
-        return 0;
-
     server_t* sv = __get_server_from_nodeid(sys, dst_node_id);
-    if (!sv)
+    server_t* sender = __get_server_from_nodeid(sys, raft_get_nodeid(raft));
+
+    /* drop rate, which coalesced messages suffer a packet at a time;
+     * partitions cut traffic both ways, and crashed servers are silent */
+    int lost = !opts.coalesce && random() % 100 < atoi(opts.drop_rate);
+    if (lost || !sv || sv->partitioned ||
+        (sender && (sender->partitioned ||
+                    NODE_DISCONNECTED == sender->connect_status)))
+    {
+        if (lost)
+            sys->n_packets += 1;
+        if (sys->trace && sender && 0 == group)
+            __trace(sys, TRACE_DROP, sender, sv, type, 0);
         return 0;
+    }
+
+    if (opts.coalesce && sender)
+    {
+        msg_t* m = __new_msg(sys, data, type, len, raft_get_nodeid(raft), group);
+        llqueue_offer(sender->outboxes[sv - sys->servers], m);
 
-    if (sv->partitioned)
+        if (sys->trace && 0 == group)
+            __trace(sys, TRACE_SEND, sender, sv, type, m->id);
         return 0;
+    }
 
     /* put inside peer's inbox */
     do
     {
-        msg_t* m = calloc(1, sizeof(msg_t));
-        m->type = type;
-        m->len = len;
-        m->sender = raft_get_nodeid(raft);
-        m->data = malloc(len);
-        memcpy(m->data, data, len);
+        msg_t* m = __new_msg(sys, data, type, len, raft_get_nodeid(raft), group);
         assert(sv->inbox);
         llqueue_offer(sv->inbox, m);
+        sys->n_packets += 1;
+
+        if (sys->trace && sender && 0 == group)
+            __trace(sys, TRACE_SEND, sender, sv, type, m->id);
     }
     while (random() % 100 < atoi(opts.dupe_rate));
 
-    return 1;
+    return 0;
 }
 
 int __raft_send_requestvote(raft_server_t* raft,
@@ -496,7 +1257,7 @@ int __raft_send_requestvote(raft_server_t* raft,
                             raft_node_t* node,
                             msg_requestvote_t* msg)
 {
-    return __append_msg(udata, msg, MSG_REQUESTVOTE, sizeof(*msg), raft_node_get_id(node), raft);
+    return __append_msg(udata, msg, MSG_REQUESTVOTE, sizeof(*msg), raft_node_get_id(node), raft, 0);
 }
 
 int sender_requestvote_response(raft_server_t* raft,
@@ -504,7 +1265,23 @@ int sender_requestvote_response(raft_server_t* raft,
                                 raft_node_t* node,
                                 msg_requestvote_response_t* msg)
 {
-    return __append_msg(udata, msg, MSG_REQUESTVOTE_RESPONSE, sizeof(*msg), raft_node_get_id(node), raft);
+    return __append_msg(udata, msg, MSG_REQUESTVOTE_RESPONSE, sizeof(*msg), raft_node_get_id(node), raft, 0);
+}
+
+int __raft_send_prevote(raft_server_t* raft,
+                        void* udata,
+                        raft_node_t* node,
+                        msg_prevote_t* msg)
+{
+    return __append_msg(udata, msg, MSG_PREVOTE, sizeof(*msg), raft_node_get_id(node), raft, 0);
+}
+
+int __raft_send_timeoutnow(raft_server_t* raft,
+                           void* udata,
+                           raft_node_t* node,
+                           msg_timeoutnow_t* msg)
+{
+    return __append_msg(udata, msg, MSG_TIMEOUTNOW, sizeof(*msg), raft_node_get_id(node), raft, 0);
 }
 
 int __raft_send_appendentries(raft_server_t* raft,
@@ -512,31 +1289,90 @@ int __raft_send_appendentries(raft_server_t* raft,
                               raft_node_t* node,
                               msg_appendentries_t* msg)
 {
-    msg_entry_t* entries = calloc(1, sizeof(msg_entry_t) * msg->n_entries);
-    memcpy(entries, msg->entries, sizeof(msg_entry_t) * msg->n_entries);
-    msg->entries = entries;
+    int i;
 
     /* collect stats */
     if (sys.max_entries_in_ae < msg->n_entries)
         sys.max_entries_in_ae = msg->n_entries;
-
-    return __append_msg(udata, msg, MSG_APPENDENTRIES, sizeof(*msg), raft_node_get_id(node), raft);
+    if (sys.metrics.ae_max < msg->n_entries)
+        sys.metrics.ae_max = msg->n_entries;
+    sys.ae_count += 1;
+    sys.ae_entries += msg->n_entries;
+    for (i = 0; i < msg->n_entries; i++)
+        sys.ae_bytes += msg->entries[i].data.len;
+    if (!raft_node_is_voting(node) && !raft_node_is_voting_new(node))
+        for (i = 0; i < msg->n_entries; i++)
+            sys.learner_bytes += msg->entries[i].data.len;
+
+    return __append_msg(udata, msg, MSG_APPENDENTRIES, sizeof(*msg), raft_node_get_id(node), raft, 0);
 }
 
-/** Non-voting node now has enough logs to be able to vote.
+static void __raft_read_response(
+    raft_server_t* raft,
+    void *udata,
+    void *read_udata,
+    int status)
+{
+    system_t* sys = udata;
+    read_t* read = read_udata;
+
+    if (0 != status)
+    {
+        sys->n_reads_failed += 1;
+        free(read);
+        return;
+    }
+
+    /* Linearizability
+     *  A read observes every write that completed before it started */
+    if (raft_get_last_applied_idx(raft) < read->min_applied_idx)
+    {
+        printf("stale read on node %d: applied %d, expected at least %d\n",
+               raft_get_nodeid(raft),
+               raft_get_last_applied_idx(raft),
+               read->min_applied_idx);
+        __print_stats();
+        abort();
+    }
+
+    server_t* sv = __get_server_from_nodeid(sys, raft_get_nodeid(raft));
+    sys->fsm_ops->read(sv->fsm, read->key, read->key_len);
+    histogram_record(sys->read_latency, (sys->iters - read->offered) * MSEC_PER_ITER);
+    sys->n_reads += 1;
+    free(read);
+}
+
+/** Non-voting node now has enough logs to be able to vote.
  * Append a finalization cfg log entry. */
 static int __raft_node_has_sufficient_logs(
     raft_server_t* raft,
     void *user_data,
     raft_node_t* node)
 {
-    server_t* leader = __get_leader(&sys);
-    entry_cfg_change_t *change = calloc(1, sizeof(*change));
-    change->node_id = raft_node_get_id(node);
+    server_t* sv = __get_server_from_nodeid(&sys, raft_node_get_id(node));
+
+    if (sv && -1 != sv->joined_at)
+    {
+        histogram_record(sys.catchup_latency,
+                         (sys.iters - sv->joined_at) * MSEC_PER_ITER);
+        sv->joined_at = -1;
+    }
+
+    /* --joint swaps it in with the next joint configuration change */
+    if (opts.joint)
+    {
+        if (sv)
+            sv->caught_up = 1;
+        return 0;
+    }
 
+    server_t* leader = __get_leader(&sys);
     if (!leader)
         return -1;
 
+    entry_cfg_change_t *change = calloc(1, sizeof(*change));
+    change->node_id = raft_node_get_id(node);
+
     msg_entry_t entry = {
         // FIXME: Should be random
         .id = 1,
@@ -552,12 +1388,45 @@ static int __raft_node_has_sufficient_logs(
     if (0 == e)
         return 0;
 
+    free(change);
     return -1;
 }
 
+/** Raft callback for sending a snapshot to a node missing compacted entries.
+ * The transfer is moved along by __receive_snapshot() */
+static int __raft_send_snapshot(
+    raft_server_t* raft,
+    void *udata,
+    raft_node_t* node)
+{
+    system_t* sys = udata;
+    server_t* sender = __get_server_from_nodeid(sys, raft_get_nodeid(raft));
+    server_t* sv = __get_server_from_nodeid(sys, raft_node_get_id(node));
+
+    /* the log is only compacted once the snapshot is saved */
+    assert(sender->snapshot_file);
+
+    if (!sv || sv->snapshot_recv || NODE_DISCONNECTED == sv->connect_status)
+        return 0;
+
+    snapshot_transfer_t* t = calloc(1, sizeof(*t));
+    t->file = sender->snapshot_file;
+    t->file->refs += 1;
+    t->sender = sender->node_id;
+    t->fsm = sys->fsm_ops->new(&sys->fsm_config);
+    t->reader = snapshot_reader_new(sys->fsm_ops, t->fsm);
+    t->started = sys->iters;
+    sv->snapshot_recv = t;
+    sys->n_snapshot_transfers += 1;
+    return 0;
+}
+
 raft_cbs_t raft_funcs = {
     .send_requestvote            = __raft_send_requestvote,
     .send_appendentries          = __raft_send_appendentries,
+    .send_prevote                = __raft_send_prevote,
+    .send_timeoutnow             = __raft_send_timeoutnow,
+    .send_snapshot               = __raft_send_snapshot,
     .applylog                    = __raft_applylog,
     .persist_vote                = __raft_persist_vote,
     .persist_term                = __raft_persist_term,
@@ -566,9 +1435,107 @@ raft_cbs_t raft_funcs = {
     .log_pop                     = __raft_logentry_pop,
     .log_get_node_id             = __raft_logentry_get_node_id,
     .node_has_sufficient_logs    = __raft_node_has_sufficient_logs,
-    .log                         = __raft_log,
+    .read_response               = __raft_read_response,
+    .log_event                   = __raft_log,
+};
+
+static int __raft_send_group_requestvote(raft_server_t* raft,
+                                         void* udata,
+                                         raft_node_t* node,
+                                         msg_requestvote_t* msg)
+{
+    group_t* g = udata;
+    return __append_msg(&sys, msg, MSG_REQUESTVOTE, sizeof(*msg),
+                        raft_node_get_id(node), raft, g->idx);
+}
+
+static int __raft_send_group_prevote(raft_server_t* raft,
+                                     void* udata,
+                                     raft_node_t* node,
+                                     msg_prevote_t* msg)
+{
+    group_t* g = udata;
+    return __append_msg(&sys, msg, MSG_PREVOTE, sizeof(*msg),
+                        raft_node_get_id(node), raft, g->idx);
+}
+
+static int __raft_send_group_appendentries(raft_server_t* raft,
+                                           void* udata,
+                                           raft_node_t* node,
+                                           msg_appendentries_t* msg)
+{
+    group_t* g = udata;
+    return __append_msg(&sys, msg, MSG_APPENDENTRIES, sizeof(*msg),
+                        raft_node_get_id(node), raft, g->idx);
+}
+
+/* extra groups only elect leaders and heartbeat, so they don't apply or
+ * change membership */
+raft_cbs_t group_funcs = {
+    .send_requestvote            = __raft_send_group_requestvote,
+    .send_appendentries          = __raft_send_group_appendentries,
+    .send_prevote                = __raft_send_group_prevote,
 };
 
+static void __free_msg(msg_t* m)
+{
+    if (MSG_APPENDENTRIES == m->type)
+        free(((msg_appendentries_t*)m->data)->entries);
+    free(m->data);
+    free(m);
+}
+
+static void __empty_inbox(server_t* sv)
+{
+    msg_t* m;
+
+    assert(sv->inbox);
+    while ((m = llqueue_poll(sv->inbox)))
+        __free_msg(m);
+}
+
+/** Send each server's queued messages to each peer as one packet */
+static void __flush_outboxes(system_t* sys)
+{
+    int i, j;
+
+    for (i = 0; i < sys->n_servers; i++)
+    {
+        server_t* sender = &sys->servers[i];
+
+        for (j = 0; j < sys->n_servers; j++)
+        {
+            server_t* sv = &sys->servers[j];
+            void* outbox = sender->outboxes[j];
+            msg_t* m;
+
+            if (0 == llqueue_count(outbox))
+                continue;
+
+            sys->n_packets += 1;
+            int lost = random() % 100 < atoi(opts.drop_rate);
+            int dupe = !lost && random() % 100 < atoi(opts.dupe_rate);
+
+            while ((m = llqueue_poll(outbox)))
+            {
+                if (lost)
+                {
+                    if (sys->trace && 0 == m->group)
+                        __trace(sys, TRACE_DROP, sender, sv, m->type, 0);
+                    __free_msg(m);
+                    continue;
+                }
+
+                if (dupe)
+                    llqueue_offer(sv->inbox, __new_msg(sys, m->data, m->type,
+                                                       m->len, m->sender,
+                                                       m->group));
+                llqueue_offer(sv->inbox, m);
+            }
+        }
+    }
+}
+
 /**
  * Become a new node
  */
@@ -578,34 +1545,76 @@ static void __recycle_node(server_t* node)
 
     /* New servers SHOULD create a new node id for themselves */
     node->node_id = random();
+    node->leaving = 0;
+    node->caught_up = 0;
 
     sys.num_unique_nodes += 1;
 
     /* make sure inbox is empty */
-    assert(node->inbox);
-    while (llqueue_poll(node->inbox));
+    __empty_inbox(node);
 }
 
 static void __create_node(server_t* sv, int id, system_t* sys)
 {
     sv->raft = raft_new();
-    sv->fsm = fsm_kvstore_new(FSM_SIZE);
+    sv->fsm = sys->fsm_ops->new(&sys->fsm_config);
     raft_set_callbacks(sv->raft, &raft_funcs, sys);
     raft_set_election_timeout(sv->raft, 500);
+    if (opts.lease_drift)
+        raft_set_lease_reads(sv->raft, atoi(opts.lease_drift));
+    raft_set_check_quorum(sv->raft, opts.check_quorum);
+    if (opts.learner_bandwidth)
+        raft_set_learner_bandwidth(sv->raft, atoi(opts.learner_bandwidth));
+    sv->clock_rate = 100;
+    sv->joined_at = -1;
     sv->inbox = llqueue_new();
+    if (opts.coalesce)
+    {
+        int i;
+        sv->outboxes = calloc(sys->n_servers, sizeof(void*));
+        for (i = 0; i < sys->n_servers; i++)
+            sv->outboxes[i] = llqueue_new();
+    }
     __set_connect_status(sv, NODE_DISCONNECTED);
     sv->node_id = id;
     sys->num_unique_nodes += 1;
 }
 
+/**
+ * Create the server's extra groups, each with every server as a member
+ */
+static void __create_groups(server_t* sv, system_t* sys)
+{
+    int g, j;
+
+    sv->groups = calloc(sys->n_groups, sizeof(group_t));
+    for (g = 1; g < sys->n_groups; g++)
+    {
+        group_t* group = &sv->groups[g];
+        group->idx = g;
+        group->raft = raft_new();
+        raft_set_callbacks(group->raft, &group_funcs, group);
+        raft_set_election_timeout(group->raft, 500);
+        raft_set_check_quorum(group->raft, opts.check_quorum);
+        for (j = 0; j < sys->n_servers; j++)
+            raft_add_node(group->raft, &sys->servers[j], j, sv == &sys->servers[j]);
+    }
+}
+
 static void __shutdown_server(server_t* sv)
 {
     raft_clear(sv->raft);
+
+    /* it replays the log, or a snapshot, from the start when it rejoins */
+    __abandon_snapshot(sv);
+    __free_transfer(sv);
+    __unref_snapshot_file(sv->snapshot_file);
+    sv->snapshot_file = NULL;
+    sys.fsm_ops->free(sv->fsm);
+    sv->fsm = sys.fsm_ops->new(&sys.fsm_config);
     __set_connect_status(sv, NODE_DISCONNECTED);
 
-    /* empty inbox */
-    assert(sv->inbox);
-    while (llqueue_poll(sv->inbox));
+    __empty_inbox(sv);
     assert(llqueue_count(sv->inbox) == 0);
 }
 
@@ -621,13 +1630,20 @@ static void __server_poll_messages(server_t* me, system_t* sys)
     assert(me->inbox);
     while ((m = llqueue_poll(me->inbox)))
     {
-        raft_node_t* n = raft_get_node(me->raft, m->sender);
+        raft_server_t* raft =
+            0 == m->group ? me->raft : me->groups[m->group].raft;
+        raft_node_t* n = raft_get_node(raft, m->sender);
+
+        if (sys->trace && 0 == m->group)
+            __trace(sys, TRACE_RECV, me, __get_server_from_nodeid(sys, m->sender),
+                    m->type, m->id);
+
         switch (m->type)
         {
         case MSG_APPENDENTRIES:
             {
             msg_appendentries_response_t response;
-            int e = raft_recv_appendentries(me->raft, n, m->data, &response);
+            int e = raft_recv_appendentries(raft, n, m->data, &response);
             if (RAFT_ERR_SHUTDOWN == e)
                 __shutdown_server(me);
 
@@ -636,35 +1652,64 @@ static void __server_poll_messages(server_t* me, system_t* sys)
                 MSG_APPENDENTRIES_RESPONSE,
                 sizeof(response),
                 m->sender,
-                me->raft);
+                raft,
+                m->group);
             }
             break;
 
         case MSG_APPENDENTRIES_RESPONSE:
-            raft_recv_appendentries_response(me->raft, n, m->data);
+            raft_recv_appendentries_response(raft, n, m->data);
             break;
 
         case MSG_REQUESTVOTE:
             {
             msg_requestvote_response_t response;
-            raft_recv_requestvote(me->raft, n, m->data, &response);
+            raft_recv_requestvote(raft, n, m->data, &response);
             __append_msg(sys,
                 &response,
                 MSG_REQUESTVOTE_RESPONSE,
                 sizeof(response),
                 m->sender,
-                me->raft);
+                raft,
+                m->group);
             }
             break;
 
         case MSG_REQUESTVOTE_RESPONSE:
             {
-            int e = raft_recv_requestvote_response(me->raft, n, m->data);
+            int e = raft_recv_requestvote_response(raft, n, m->data);
             if (RAFT_ERR_SHUTDOWN == e)
                 __shutdown_server(me);
             }
             break;
+
+        case MSG_PREVOTE:
+            {
+            msg_prevote_response_t response;
+            raft_recv_prevote(raft, n, m->data, &response);
+            __append_msg(sys,
+                &response,
+                MSG_PREVOTE_RESPONSE,
+                sizeof(response),
+                m->sender,
+                raft,
+                m->group);
+            }
+            break;
+
+        case MSG_PREVOTE_RESPONSE:
+            raft_recv_prevote_response(raft, n, m->data);
+            break;
+
+        case MSG_TIMEOUTNOW:
+            raft_recv_timeoutnow(raft, n, m->data);
+            break;
         }
+
+        if (sys->trace)
+            __trace_server(sys, me);
+
+        __free_msg(m);
     }
 }
 
@@ -675,7 +1720,12 @@ static void __server_drop_messages(server_t* me, system_t* sys)
     /* Drop one message */
     assert(me->inbox);
     if ((m = llqueue_poll(me->inbox)))
-        free(m);
+    {
+        if (sys->trace)
+            __trace(sys, TRACE_DROP, __get_server_from_nodeid(sys, m->sender),
+                    me, m->type, 0);
+        __free_msg(m);
+    }
 }
 
 // FIXME: this is O(n^2)
@@ -716,14 +1766,36 @@ void strrnd(char* s, size_t len)
         s[i] = 'a' + random() % 64;
 }
 
-/** Add an entry to the leader */
-static void __push_entry(system_t* sys)
+/** Queue n client entries, then hand the whole queue to the leader */
+static void __push_entries(system_t* sys, int n)
 {
-    int i;
+    int i, j, accepted = 0, n_cmds = 0;
+    void** cmds = calloc(n + 1, sizeof(void*));
+
+    for (i = 0; i < n; i++)
+    {
+        if (PROPOSALS_MAX == sys->n_proposals)
+        {
+            sys->n_proposals_dropped += 1;
+            continue;
+        }
+        proposal_t* p = &sys->proposals[sys->n_proposals++];
+        p->cmd = sys->fsm_ops->cmd(sys->fsm,
+                                   workload_key(sys->workload, sys->iters));
+        p->offered = sys->iters;
+        cmds[n_cmds++] = p->cmd;
+    }
+
+    /* the master copy applies commands as they're proposed */
+    sys->fsm_ops->push_batch(sys->fsm, cmds, n_cmds);
+    free(cmds);
+
+    if (0 == sys->n_proposals)
+        return;
 
-    fsm_kvstore_cmd_t cmd;
-    fsm_kvstore_rand_cmd(sys->fsm, &cmd);
-    fsm_kvstore_push(sys->fsm, &cmd);
+    msg_entry_t* entries = calloc(sys->n_proposals, sizeof(msg_entry_t));
+    msg_entry_response_t* responses =
+        calloc(sys->n_proposals, sizeof(msg_entry_response_t));
 
     for (i = 0; i < sys->n_servers; i++)
     {
@@ -731,13 +1803,61 @@ static void __push_entry(system_t* sys)
         if (!raft_is_leader(r))
             continue;
 
-        raft_entry_t* ety = calloc(1, sizeof(raft_entry_t));
-        ety->id = sys->n_entries++;
-        ety->data.buf = malloc(sizeof(fsm_kvstore_cmd_t));
-        memcpy(ety->data.buf, &cmd, sizeof(fsm_kvstore_cmd_t));
-        ety->data.len = sizeof(fsm_kvstore_cmd_t);
-        msg_entry_response_t response;
-        raft_recv_entry(r, ety, &response);
+        for (j = 0; j < sys->n_proposals; j++)
+        {
+            msg_entry_t* ety = &entries[j];
+            ety->id = sys->n_entries++;
+            __get_entry_stat(sys, ety->id)->offered = sys->proposals[j].offered;
+            ety->data.len = sys->fsm_ops->cmd_size(sys->proposals[j].cmd);
+            ety->data.buf = malloc(ety->data.len);
+            memcpy(ety->data.buf, sys->proposals[j].cmd, ety->data.len);
+            responses[j].idx = 0;
+        }
+
+        if (0 == raft_recv_entries(r, entries, sys->n_proposals, responses))
+            accepted = 1;
+
+        /* the log only keeps the entries it appended */
+        for (j = 0; j < sys->n_proposals; j++)
+            if (0 == responses[j].idx)
+                free(entries[j].data.buf);
+    }
+
+    /* otherwise the client retries next iteration */
+    if (accepted)
+    {
+        for (j = 0; j < sys->n_proposals; j++)
+            free(sys->proposals[j].cmd);
+        sys->n_proposals = 0;
+    }
+
+    free(entries);
+    free(responses);
+}
+
+/** Make n client reads on the leader */
+static void __push_reads(system_t* sys, int n)
+{
+    int i;
+
+    for (i = 0; i < sys->n_servers; i++)
+    {
+        raft_server_t* r = sys->servers[i].raft;
+        if (!raft_is_leader(r) ||
+            NODE_DISCONNECTED == sys->servers[i].connect_status)
+            continue;
+
+        int j;
+        for (j = 0; j < n; j++)
+        {
+            read_t* read = malloc(sizeof(*read));
+            read->offered = sys->iters;
+            read->key_len = sys->fsm_ops->key(
+                sys->fsm, workload_key(sys->workload, sys->iters), read->key);
+            read->min_applied_idx = sys->max_applied_idx;
+            if (0 != raft_read_request(r, read))
+                free(read);
+        }
     }
 }
 
@@ -756,11 +1876,38 @@ static int __voting_servers(system_t* sys)
 static void __poll_messages(system_t* sys)
 {
     int i;
+
+    if (opts.coalesce)
+        __flush_outboxes(sys);
+
     for (i=0; i<sys->n_servers; i++)
         if (sys->servers[i].connect_status != NODE_DISCONNECTED)
             __server_poll_messages(&sys->servers[i], sys);
 }
 
+/**
+ * Hand leadership from the leader to another connected voting server
+ * @return 0 if a transfer started */
+static int __transfer_leadership(system_t* sys, server_t* leader)
+{
+    int i, start = random() % sys->n_servers;
+
+    for (i = 0; i < sys->n_servers; i++)
+    {
+        server_t* sv = &sys->servers[(start + i) % sys->n_servers];
+        if (sv == leader || NODE_CONNECTED != sv->connect_status)
+            continue;
+
+        if (0 == raft_transfer_leader(leader->raft, sv->node_id))
+        {
+            sys->n_transfers += 1;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
 /**
  * Remove or add this node to the cluster
  * Automatically create membership change entry. Give the entry to the leader.
@@ -768,13 +1915,17 @@ static void __poll_messages(system_t* sys)
 static void __toggle_membership(server_t* node)
 {
     server_t* leader = __get_leader(&sys);
-    entry_cfg_change_t *change = calloc(1, sizeof(*change));
 
     if (!leader)
         return;
 
+    /* Move leadership away first; the node can be demoted once it's a
+     * follower */
     if (leader == node)
+    {
+        __transfer_leadership(&sys, leader);
         return;
+    }
 
     if (NODE_DISCONNECTING == node->connect_status)
         return;
@@ -782,11 +1933,19 @@ static void __toggle_membership(server_t* node)
     if (NODE_CONNECTING == node->connect_status)
         return;
 
+    /* --joint demotes it with the next joint configuration change */
+    if (opts.joint && NODE_CONNECTED == node->connect_status)
+    {
+        node->leaving = 1;
+        return;
+    }
+
     if (NODE_DISCONNECTED == node->connect_status)
         __recycle_node(node);
 
     /* Create a new configuration entry to be processed by the leader */
 
+    entry_cfg_change_t *change = calloc(1, sizeof(*change));
     change->node_id = node->node_id;
 
     msg_entry_t entry = {
@@ -804,13 +1963,17 @@ static void __toggle_membership(server_t* node)
     msg_entry_response_t r;
     int e = raft_recv_entry(leader->raft, &entry, &r);
     if (0 != e)
+    {
+        free(change);
         return;
+    }
     else
         sys.num_membership_changes += 1;
 
     if (NODE_DISCONNECTED == node->connect_status)
     {
         __set_connect_status(node, NODE_CONNECTING);
+        node->joined_at = sys.iters;
 
         raft_node_t* added_node = raft_add_non_voting_node(node->raft, NULL, node->node_id, 1);
 
@@ -824,16 +1987,191 @@ static void __toggle_membership(server_t* node)
     }
 }
 
+/**
+ * Demote the servers waiting to leave and promote the ones that caught up, all
+ * in one joint configuration change. See --joint
+ */
+static void __swap_members(system_t* sys)
+{
+    server_t* leader = __get_leader(sys);
+    int i, n = 0;
+
+    if (!leader || raft_voting_change_is_in_progress(leader->raft) ||
+        raft_is_joint(leader->raft))
+        return;
+
+    msg_entry_t* entries = calloc(sys->n_servers, sizeof(msg_entry_t));
+    msg_entry_response_t* responses =
+        calloc(sys->n_servers, sizeof(msg_entry_response_t));
+
+    for (i = 0; i < sys->n_servers; i++)
+    {
+        server_t* sv = &sys->servers[i];
+        int type;
+
+        /* the leader leaves once it transferred leadership */
+        if (sv == leader)
+            continue;
+        else if (sv->leaving && NODE_CONNECTED == sv->connect_status)
+            type = RAFT_LOGTYPE_JOINT_DEMOTE_NODE;
+        else if (sv->caught_up && NODE_CONNECTING == sv->connect_status)
+            type = RAFT_LOGTYPE_JOINT_ADD_NODE;
+        else
+            continue;
+
+        entry_cfg_change_t *change = calloc(1, sizeof(*change));
+        change->node_id = sv->node_id;
+
+        // FIXME: Should be random
+        entries[n].id = 1;
+        entries[n].data.buf = (void*)change;
+        entries[n].data.len = sizeof(*change);
+        entries[n].type = type;
+        n++;
+    }
+
+    if (n)
+        raft_recv_entries(leader->raft, entries, n, responses);
+
+    for (i = 0; i < n; i++)
+    {
+        entry_cfg_change_t *change = entries[i].data.buf;
+        server_t* sv = __get_server_from_nodeid(sys, change->node_id);
+
+        /* the log only keeps the entries it appended */
+        if (0 == responses[i].idx)
+        {
+            free(change);
+            continue;
+        }
+
+        if (RAFT_LOGTYPE_JOINT_DEMOTE_NODE == entries[i].type)
+        {
+            sv->leaving = 0;
+            __set_connect_status(sv, NODE_DISCONNECTING);
+            sys->num_membership_changes += 1;
+        }
+        else
+            sv->caught_up = 0;
+    }
+
+    if (n && responses[0].idx)
+    {
+        sys->n_joint_changes += 1;
+        if (sys->max_joint_size < n)
+            sys->max_joint_size = n;
+    }
+
+    free(entries);
+    free(responses);
+}
+
+/** Replace the server's log and state machine with the snapshot it
+ * received */
+static void __install_snapshot(system_t* sys, server_t* sv)
+{
+    snapshot_transfer_t* t = sv->snapshot_recv;
+    snapshot_header_t* h = &t->reader->header;
+    int i;
+
+    /* it caught up some other way meanwhile, or stood for election; the
+     * leader sends another snapshot if it still needs one */
+    int e = raft_begin_load_snapshot(sv->raft, h->last_idx, h->last_term);
+    if (RAFT_ERR_NOT_FOLLOWER == e || RAFT_ERR_STALE_SNAPSHOT == e)
+        return;
+
+    __abandon_snapshot(sv);
+    sys->fsm_ops->free(sv->fsm);
+    sv->fsm = t->fsm;
+    t->fsm = NULL;
+
+    for (i = 0; i < h->n_nodes; i++)
+    {
+        snapshot_node_t* n = &t->reader->nodes[i];
+        raft_node_t* node = raft_get_node(sv->raft, n->id);
+        if (!node)
+            node = raft_add_non_voting_node(sv->raft, NULL, n->id, 0);
+        raft_node_set_voting(node, n->voting);
+        raft_node_set_voting_new(node, n->voting_new);
+    }
+    raft_end_load_snapshot(sv->raft);
+
+    /* State Machine Safety, as for applying up to the snapshot's idx */
+    __check_digest(sys, sv, h->last_idx - 1);
+
+    raft_node_t* me = raft_get_my_node(sv->raft);
+    if (me && raft_node_is_voting(me) &&
+        NODE_CONNECTING == sv->connect_status)
+        __set_connect_status(sv, NODE_CONNECTED);
+
+    /* kept so that it can be sent on */
+    __unref_snapshot_file(sv->snapshot_file);
+    sv->snapshot_file = t->file;
+    t->file = NULL;
+
+    histogram_record(sys->install_latency,
+                     (sys->iters - t->started) * MSEC_PER_ITER);
+    sys->n_snapshots_installed += 1;
+}
+
+/** Send the server the next part of the snapshot it's receiving. The
+ * transfer is dropped if either end is cut off; the sender starts another */
+static void __receive_snapshot(system_t* sys, server_t* sv)
+{
+    snapshot_transfer_t* t = sv->snapshot_recv;
+    server_t* sender = __get_server_from_nodeid(sys, t->sender);
+
+    if (!sender || sender->partitioned || sv->partitioned ||
+        NODE_DISCONNECTED == sender->connect_status ||
+        NODE_DISCONNECTED == sv->connect_status)
+    {
+        __free_transfer(sv);
+        return;
+    }
+
+    long n = t->file->len - t->offset;
+    if (sys->snapshot_bytes_per_iter < n)
+        n = sys->snapshot_bytes_per_iter;
+
+    if (0 != snapshot_reader_write(t->reader, t->file->data + t->offset, n))
+    {
+        printf("node %d received a corrupt snapshot from node %d at "
+               "offset %ld\n", sv->node_id, sender->node_id, t->offset);
+        __print_stats();
+        abort();
+    }
+    t->offset += n;
+    sys->snapshot_bytes_sent += n;
+
+    if (!snapshot_reader_is_done(t->reader))
+        return;
+
+    __install_snapshot(sys, sv);
+    __free_transfer(sv);
+}
+
 static void __periodic(system_t* sys)
 {
     if (opts.debug)
         printf("\n");
 
-    if (random() % 100 < sys->client_rate)
-        __push_entry(sys);
+    int n_writes, n_reads;
+    workload_arrivals(sys->workload, sys->iters, &n_writes, &n_reads);
+
+    __push_entries(sys, n_writes);
+
+    if (n_reads)
+        __push_reads(sys, n_reads);
+
+    if (opts.joint)
+        __swap_members(sys);
 
     __poll_messages(sys);
 
+    /* leases only hold if servers agree on how much time passed, up to their
+     * clock skew */
+    int period = sys->shared_clock ? random() % 100 : -1;
+
     int i;
     for (i = 0; i < sys->n_servers; i++)
     {
@@ -844,7 +2182,8 @@ static void __periodic(system_t* sys)
 
         if (!opts.no_random_period && sv->connect_status != NODE_DISCONNECTED)
         {
-            int e = raft_periodic(sv->raft, random() % 100);
+            int msec = -1 == period ? random() % 100 : period;
+            int e = raft_periodic(sv->raft, msec * sv->clock_rate / 100);
             if (-1 == e)
             {
                 printf("ERROR node %d\n", raft_get_nodeid(sv->raft));
@@ -858,6 +2197,25 @@ static void __periodic(system_t* sys)
                 if (RAFT_ERR_SHUTDOWN == e)
                     __shutdown_server(sv);
             }
+
+            if (sv->snapshot_writer)
+                __serialize_snapshot(sys, sv);
+
+            if (sv->snapshot_recv)
+                __receive_snapshot(sys, sv);
+
+            /* every group on a server shares its tick */
+            int g;
+            for (g = 1; g < sys->n_groups; g++)
+                if (-1 == raft_periodic(sv->groups[g].raft,
+                                        msec * sv->clock_rate / 100))
+                {
+                    printf("ERROR node %d group %d\n", sv->node_id, g);
+                    assert(0);
+                }
+
+            if (sys->trace)
+                __trace_server(sys, sv);
         }
     }
 
@@ -870,67 +2228,194 @@ static void __periodic(system_t* sys)
         sys->leadership_changes += 1;
 
     sys->leader = raft_get_current_leader_node(sys->servers[0].raft);
+
+    sys->iters += 1;
+    sys->trace_seq = 0;
+    if (sys->metrics.out && 0 == sys->iters % sys->metrics.interval)
+        __metrics_row(sys);
 }
 
 #include "command_parser.c"
 
-int main(int argc, char **argv)
+static int __value_dist(const char* name)
 {
-    int e, i;
+    if (!strcmp(name, "fixed"))
+        return FSM_VALUE_FIXED;
+    else if (!strcmp(name, "uniform"))
+        return FSM_VALUE_UNIFORM;
+    else if (!strcmp(name, "exp"))
+        return FSM_VALUE_EXP;
+
+    fprintf(stderr, "--value_dist needs to be fixed, uniform or exp\n");
+    exit(-1);
+}
 
-    e = parse_options(argc, argv, &opts);
-    if (-1 == e)
-        exit(-1);
-    else if (opts.help)
-    {
-        show_usage();
-        exit(0);
-    }
-    else if (opts.version)
-    {
-        fprintf(stdout, "%s\n", VERSION);
-        exit(0);
-    }
+static int __key_dist(const char* name)
+{
+    if (!strcmp(name, "uniform"))
+        return WORKLOAD_KEYS_UNIFORM;
+    else if (!strcmp(name, "zipf"))
+        return WORKLOAD_KEYS_ZIPF;
+    else if (!strcmp(name, "hotspot"))
+        return WORKLOAD_KEYS_HOTSPOT;
+
+    fprintf(stderr, "--key_dist needs to be uniform, zipf or hotspot\n");
+    exit(-1);
+}
 
-    if (!opts.debug)
-        raft_funcs.log = NULL;
+static fsm_ops_t* __fsm_ops(const char* name)
+{
+    fsm_ops_t* fsms[] = { &fsm_simple_ops, &fsm_kvstore_ops, &fsm_heavy_ops };
+    int i;
 
-    signal(SIGPIPE, SIG_IGN);
-    signal(SIGINT, __int_handler);
+    for (i = 0; i < (int)len(fsms); i++)
+        if (!strcmp(name, fsms[i]->name))
+            return fsms[i];
+
+    fprintf(stderr, "--fsm needs to be simple, kvstore or heavy\n");
+    exit(-1);
+}
+
+/**
+ * Create the servers, the leader and the initial configuration from opts
+ */
+static void __init_system(system_t* sys)
+{
+    int e, i;
 
     srand(atoi(opts.seed));
 
-    sys.commits = farraylist_new();
-    sys.fsm = fsm_kvstore_new(FSM_SIZE);
+    raft_funcs.send_prevote = opts.prevote ? __raft_send_prevote : NULL;
+    group_funcs.send_prevote =
+        opts.prevote ? __raft_send_group_prevote : NULL;
+
+    sys->commits = farraylist_new(1024);
+    sys->entry_bufs = llqueue_new();
+    sys->commit_latency = histogram_new();
+    sys->apply_latency = histogram_new();
+    sys->fsm_ops = __fsm_ops(opts.fsm);
+    sys->fsm_config.key_space = atoi(opts.keys);
+    sys->fsm_config.value_size = atoi(opts.value_size);
+    sys->fsm_config.value_dist = __value_dist(opts.value_dist);
+    if (sys->fsm_config.key_space < 1 || sys->fsm_config.value_size < 0 ||
+        FSM_KVSTORE_VALUE_MAX < sys->fsm_config.value_size)
+    {
+        fprintf(stderr, "--keys needs to be at least 1, and --value_size "
+                "between 0 and %d\n", FSM_KVSTORE_VALUE_MAX);
+        exit(-1);
+    }
+    sys->fsm = sys->fsm_ops->new(&sys->fsm_config);
 
-    sys.n_servers = atoi(opts.servers);
-    sys.servers = calloc(sys.n_servers, sizeof(*sys.servers));
+    if (opts.learner_bandwidth && atoi(opts.learner_bandwidth) < 0)
+    {
+        fprintf(stderr, "--learner_bandwidth can't be negative\n");
+        exit(-1);
+    }
 
-    for (i = 0; i < sys.n_servers; i++)
-        __create_node(&sys.servers[i], i, &sys);
+    sys->n_servers = atoi(opts.servers);
+    sys->servers = calloc(sys->n_servers, sizeof(*sys->servers));
+
+    int skew = atoi(opts.clock_skew);
+    sys->shared_clock = skew || opts.lease_drift;
+    for (i = 0; i < sys->n_servers; i++)
+    {
+        __create_node(&sys->servers[i], i, sys);
+        if (skew)
+            sys->servers[i].clock_rate = 100 - skew + random() % (2 * skew + 1);
+    }
 
-    server_t* sv = &sys.servers[0];
+    server_t* sv = &sys->servers[0];
     raft_add_non_voting_node(sv->raft, NULL, 0, 1);
     raft_become_leader(sv->raft);
     __set_connect_status(sv, NODE_CONNECTED);
 
-    sys.client_rate = atoi(opts.client_rate);
-    sys.membership_rate = atoi(opts.member_rate);
+    if (opts.trace)
+        sys->trace = trace_new(atoi(opts.trace_size));
+
+    workload_config_t workload = {
+        .key_space = sys->fsm_config.key_space,
+        .key_dist = __key_dist(opts.key_dist),
+        .zipf_theta = atof(opts.zipf_theta),
+        .hot_keys = atoi(opts.hot_keys),
+        .hot_ops = atoi(opts.hot_ops),
+        .write_rate = atoi(opts.client_rate),
+        .read_rate = atoi(opts.read_rate),
+        .ops_per_sec = opts.ops_per_sec ? atof(opts.ops_per_sec) : 0,
+        .read_pct = atoi(opts.read_pct),
+        .burst_every = opts.burst_every ? atoi(opts.burst_every) : 0,
+        .burst_len = atoi(opts.burst_len),
+        .burst_factor = atoi(opts.burst_factor),
+    };
+    sys->workload = workload_new(&workload, MSEC_PER_ITER);
+    if (!sys->workload)
+    {
+        fprintf(stderr, "client rates, percentages, --zipf_theta and burst "
+                "lengths can't be negative, and --burst_factor needs to be "
+                "at least 1\n");
+        exit(-1);
+    }
+    sys->proposals = calloc(PROPOSALS_MAX, sizeof(proposal_t));
+    sys->read_latency = histogram_new();
+    sys->catchup_latency = histogram_new();
+    sys->membership_rate = atoi(opts.member_rate);
+    sys->snapshot_latency = histogram_new();
+    sys->install_latency = histogram_new();
+    if (opts.snapshot_every)
+        sys->snapshot_every = atoi(opts.snapshot_every);
+    sys->snapshot_bytes_per_iter =
+        (long)atoi(opts.snapshot_bandwidth) * MSEC_PER_ITER / 1000;
+    if (sys->snapshot_every < 0 || sys->snapshot_bytes_per_iter < 1)
+    {
+        fprintf(stderr, "--snapshot_every can't be negative, and "
+                "--snapshot_bandwidth needs to be at least %d\n",
+                1000 / MSEC_PER_ITER);
+        exit(-1);
+    }
+
+    /* node IDs only stay put in a static configuration, and extra groups
+     * are addressed by them */
+    sys->n_groups = atoi(opts.groups);
+    if (sys->n_groups < 1 || (1 < sys->n_groups && sys->membership_rate))
+    {
+        fprintf(stderr, "--groups needs to be at least 1, and more than 1 "
+                "needs --member_rate 0\n");
+        exit(-1);
+    }
+
+    if (opts.metrics)
+    {
+        sys->metrics.out = fopen(opts.metrics, "w");
+        if (!sys->metrics.out)
+        {
+            perror(opts.metrics);
+            exit(-1);
+        }
+        /* rows are small and frequent; let stdio batch them */
+        setvbuf(sys->metrics.out, NULL, _IOFBF, 1 << 16);
+        sys->metrics.interval = atoi(opts.metrics_interval);
+        sys->metrics.commit_latency = histogram_new();
+        sys->metrics.apply_latency = histogram_new();
+        if (sys->metrics.interval <= 0)
+            sys->metrics.interval = 1;
+        __metrics_header(sys);
+    }
 
     /* if a 0 membership rate, it means this is a static configuration */
-    if (0 == sys.membership_rate)
+    if (0 == sys->membership_rate)
     {
-        for (i = 0; i < sys.n_servers; i++)
+        for (i = 0; i < sys->n_servers; i++)
         {
-            server_t* sv = &sys.servers[i];
+            server_t* sv = &sys->servers[i];
             __set_connect_status(sv, NODE_CONNECTED);
 
             int j;
-            for (j = 0; j < sys.n_servers; j++)
+            for (j = 0; j < sys->n_servers; j++)
             {
-                server_t* other = &sys.servers[j];
+                server_t* other = &sys->servers[j];
                 raft_add_node(sv->raft, other, j, i==j);
             }
+
+            __create_groups(sv, sys);
         }
     }
     else
@@ -952,6 +2437,89 @@ int main(int argc, char **argv)
         raft_set_commit_idx(sv->raft, 0 + 1);
         raft_apply_all(sv->raft);
     }
+}
+
+static void __free_system(system_t* sys)
+{
+    int i;
+
+    for (i = 0; i < sys->n_servers; i++)
+    {
+        server_t* sv = &sys->servers[i];
+        int j;
+
+        __empty_inbox(sv);
+        llqueue_free(sv->inbox);
+        raft_free(sv->raft);
+        for (j = 1; sv->groups && j < sys->n_groups; j++)
+            raft_free(sv->groups[j].raft);
+        free(sv->groups);
+        for (j = 0; sv->outboxes && j < sys->n_servers; j++)
+        {
+            msg_t* m;
+            while ((m = llqueue_poll(sv->outboxes[j])))
+                __free_msg(m);
+            llqueue_free(sv->outboxes[j]);
+        }
+        free(sv->outboxes);
+        __abandon_snapshot(sv);
+        __free_transfer(sv);
+        __unref_snapshot_file(sv->snapshot_file);
+        sys->fsm_ops->free(sv->fsm);
+    }
+    for (i = 0; i < sys->n_proposals; i++)
+        free(sys->proposals[i].cmd);
+    free(sys->servers);
+    free(sys->entry_stats);
+    free(sys->digests);
+    free(sys->proposals);
+    sys->fsm_ops->free(sys->fsm);
+    for (i = 0; i < farraylist_get_size(sys->commits); i++)
+        free(farraylist_get(sys->commits, i));
+    farraylist_free(sys->commits);
+    /* some entries have no data */
+    while (0 < llqueue_count(sys->entry_bufs))
+        free(llqueue_poll(sys->entry_bufs));
+    llqueue_free(sys->entry_bufs);
+    histogram_free(sys->commit_latency);
+    histogram_free(sys->apply_latency);
+    histogram_free(sys->read_latency);
+    histogram_free(sys->catchup_latency);
+    histogram_free(sys->snapshot_latency);
+    histogram_free(sys->install_latency);
+    histogram_free(sys->metrics.commit_latency);
+    histogram_free(sys->metrics.apply_latency);
+    if (sys->trace)
+        trace_free(sys->trace);
+    workload_free(sys->workload);
+}
+
+int main(int argc, char **argv)
+{
+    int e;
+
+    e = parse_options(argc, argv, &opts);
+    if (-1 == e)
+        exit(-1);
+    else if (opts.help)
+    {
+        show_usage();
+        exit(0);
+    }
+    else if (opts.version)
+    {
+        fprintf(stdout, "%s\n", VERSION);
+        exit(0);
+    }
+
+    if (!opts.debug)
+        raft_funcs.log_event = NULL;
+
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, __int_handler);
+    signal(SIGABRT, __abrt_handler);
+
+    __init_system(&sys);
 
     /* We're being fed commands via stdin.
      * This is the fuzzer's entry point */
@@ -983,7 +2551,65 @@ int main(int argc, char **argv)
         printf("Log pops: %d\n", sys.log_pops);
         printf("Unique nodes: %d\n", sys.num_unique_nodes);
         printf("Membership changes: %d\n", sys.num_membership_changes);
+        if (opts.joint)
+            printf("Joint configuration changes: %d, swapping up to %d servers\n",
+                   sys.n_joint_changes, sys.max_joint_size);
+        printf("Leadership transfers: %d\n", sys.n_transfers);
+        printf("Client operations: %ld writes, %ld reads, %.1f%% on hot keys, "
+               "%ld in bursts\n",
+               sys.workload->n_writes, sys.workload->n_reads,
+               sys.workload->n_keys ?
+               100.0 * sys.workload->n_hot_keys / sys.workload->n_keys : 0.0,
+               sys.workload->n_burst_ops);
+        printf("Dropped client entries: %d\n", sys.n_proposals_dropped);
+        printf("Suppressed vote requests: %d\n", __suppressed_votes(&sys));
+        printf("Check-quorum step downs: %d\n", __quorum_step_downs(&sys));
+        printf("Packets: %d carrying %d messages\n", sys.n_packets, sys.n_msgs);
+        server_t* leader = __get_leader(&sys);
+        if (leader)
+        {
+            int n_keys;
+            long bytes;
+            sys.fsm_ops->size(leader->fsm, &n_keys, &bytes);
+            printf("Leader's state machine: %d keys, %ld bytes\n",
+                   n_keys, bytes);
+        }
+        printf("Applied by %s state machines: %ld commands\n",
+               sys.fsm_ops->name, sys.n_applied);
+        if (1 < sys.n_groups)
+            printf("Extra groups with a leader: %d of %d\n",
+                   __groups_with_leader(&sys), sys.n_groups - 1);
+        __print_latency("Commit", sys.commit_latency);
+        __print_latency("Apply on all servers", sys.apply_latency);
+        if (sys.membership_rate)
+        {
+            printf("Bytes sent to non-voting servers: %ld\n", sys.learner_bytes);
+            __print_latency("Catch-up", sys.catchup_latency);
+        }
+        if (sys.snapshot_every)
+        {
+            printf("Snapshots: %d taken, %d skipped, %ld pages copied\n",
+                   sys.n_snapshots, sys.n_snapshots_skipped,
+                   sys.snapshot_pages_copied);
+            __print_latency("Snapshot serialization", sys.snapshot_latency);
+            printf("Snapshots sent: %d, %d installed, %ld bytes\n",
+                   sys.n_snapshot_transfers, sys.n_snapshots_installed,
+                   sys.snapshot_bytes_sent);
+            __print_latency("Snapshot install", sys.install_latency);
+        }
+        if (sys.workload->n_reads)
+        {
+            printf("Reads: %d served, %d failed\n", sys.n_reads, sys.n_reads_failed);
+            __print_latency("Read", sys.read_latency);
+        }
     }
 
+    if (sys.metrics.out)
+        fclose(sys.metrics.out);
+
+    __trace_dump(&sys);
+
+    __free_system(&sys);
+
     return 0;
 }
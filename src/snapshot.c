@@ -0,0 +1,293 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <assert.h>
+
+#include "snapshot.h"
+
+/* most nodes a configuration can have before the header is taken to be
+ * corrupt */
+#define NODES_MAX 65536
+
+/* bytes of the header covered by its CRC */
+#define HEADER_CRC_LEN offsetof(snapshot_header_t, crc)
+
+static unsigned int __crc_table[256];
+
+/* CRC-32 as used by zlib and ethernet */
+static unsigned int __crc32(unsigned int crc, const char* buf, long len)
+{
+    long i;
+
+    if (!__crc_table[1])
+    {
+        unsigned int n, k, c;
+        for (n = 0; n < 256; n++)
+        {
+            for (c = n, k = 0; k < 8; k++)
+                c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            __crc_table[n] = c;
+        }
+    }
+
+    crc = ~crc;
+    for (i = 0; i < len; i++)
+        crc = __crc_table[(crc ^ (unsigned char)buf[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+snapshot_writer_t* snapshot_writer_new(fsm_ops_t* ops, fsm_snapshot_t* fsm,
+                                       int last_idx, int last_term,
+                                       snapshot_node_t* nodes, int n_nodes)
+{
+    snapshot_writer_t* me = calloc(1, sizeof(*me));
+    snapshot_header_t* h;
+    int nodes_len = n_nodes * sizeof(snapshot_node_t);
+
+    me->ops = ops;
+    me->fsm = fsm;
+    me->remaining = fsm->size;
+
+    /* big enough for every chunk after the header too */
+    me->buf = calloc(1, sizeof(*h) + nodes_len +
+                     sizeof(snapshot_chunk_t) + SNAPSHOT_CHUNK_SIZE);
+    me->buf_len = sizeof(*h) + nodes_len;
+
+    h = (snapshot_header_t*)me->buf;
+    h->magic = SNAPSHOT_MAGIC;
+    h->version = SNAPSHOT_VERSION;
+    strncpy(h->fsm, ops->name, sizeof(h->fsm) - 1);
+    h->last_idx = last_idx;
+    h->last_term = last_term;
+    h->n_nodes = n_nodes;
+    h->chunk_size = SNAPSHOT_CHUNK_SIZE;
+    h->size = me->remaining;
+    h->digest = fsm->digest;
+    memcpy(me->buf + sizeof(*h), nodes, nodes_len);
+    h->crc = __crc32(__crc32(0, me->buf, HEADER_CRC_LEN),
+                     me->buf + sizeof(*h), nodes_len);
+    return me;
+}
+
+/**
+ * Fill buf with the next chunk
+ * @return 0 if there are no chunks left */
+static int __next_chunk(snapshot_writer_t* me)
+{
+    snapshot_chunk_t* chunk = (snapshot_chunk_t*)me->buf;
+    int len = 0;
+
+    if (0 == me->remaining)
+        return 0;
+
+    chunk->len = me->remaining < SNAPSHOT_CHUNK_SIZE ?
+        me->remaining : SNAPSHOT_CHUNK_SIZE;
+    while (len < chunk->len)
+    {
+        int n = me->ops->snapshot_read(me->fsm,
+                                       me->buf + sizeof(*chunk) + len,
+                                       chunk->len - len);
+        /* the state machine is as big as its snapshot said */
+        assert(0 < n);
+        len += n;
+    }
+    chunk->crc = __crc32(0, me->buf + sizeof(*chunk), chunk->len);
+
+    me->remaining -= chunk->len;
+    me->buf_len = sizeof(*chunk) + chunk->len;
+    me->offset = 0;
+    return 1;
+}
+
+int snapshot_writer_read(snapshot_writer_t* me, char* buf, int size)
+{
+    int n = 0;
+
+    while (n < size)
+    {
+        if (me->offset == me->buf_len && !__next_chunk(me))
+            break;
+
+        int k = me->buf_len - me->offset;
+        if (size - n < k)
+            k = size - n;
+        memcpy(buf + n, me->buf + me->offset, k);
+        me->offset += k;
+        n += k;
+    }
+
+    return n;
+}
+
+void snapshot_writer_free(snapshot_writer_t* me)
+{
+    free(me->buf);
+    free(me);
+}
+
+/**
+ * Start receiving the next part of the snapshot */
+static void __expect(snapshot_reader_t* me, int state, int size)
+{
+    me->state = state;
+    me->part_size = size;
+    me->part_len = 0;
+}
+
+static int __corrupt(snapshot_reader_t* me)
+{
+    me->state = SNAPSHOT_READER_CORRUPT;
+    return -1;
+}
+
+snapshot_reader_t* snapshot_reader_new(fsm_ops_t* ops, fsm_t fsm)
+{
+    snapshot_reader_t* me = calloc(1, sizeof(*me));
+    me->ops = ops;
+    me->fsm = fsm;
+    me->part = malloc(sizeof(snapshot_header_t));
+    me->cmd = malloc(ops->cmd_max_size);
+    __expect(me, SNAPSHOT_READER_HEADER, sizeof(snapshot_header_t));
+    return me;
+}
+
+/**
+ * Restore the commands in a chunk; the last one may continue in the next
+ * chunk
+ * @return 0 on success; -1 if a command is invalid */
+static int __restore(snapshot_reader_t* me, const char* buf, int len)
+{
+    int header_size = me->ops->cmd_header_size;
+
+    while (0 < len)
+    {
+        int size = header_size;
+        if (header_size <= me->cmd_len)
+            size = me->ops->cmd_size(me->cmd);
+
+        int k = size - me->cmd_len < len ? size - me->cmd_len : len;
+        memcpy(me->cmd + me->cmd_len, buf, k);
+        me->cmd_len += k;
+        buf += k;
+        len -= k;
+
+        if (me->cmd_len < header_size)
+            continue;
+
+        /* copied into cmd so that it's aligned */
+        size = me->ops->cmd_size(me->cmd);
+        if (size < header_size || me->ops->cmd_max_size < size)
+            return -1;
+        if (me->cmd_len < size)
+            continue;
+
+        if (0 != me->ops->restore(me->fsm, me->cmd))
+            return -1;
+        me->cmd_len = 0;
+    }
+
+    return 0;
+}
+
+/**
+ * Act on a part once all of it has been received
+ * @return 0 on success; -1 if the snapshot is corrupt */
+static int __received(snapshot_reader_t* me)
+{
+    snapshot_header_t* h = &me->header;
+
+    switch (me->state)
+    {
+        case SNAPSHOT_READER_HEADER:
+            memcpy(h, me->part, sizeof(*h));
+            if (SNAPSHOT_MAGIC != h->magic || SNAPSHOT_VERSION != h->version ||
+                0 != strncmp(h->fsm, me->ops->name, sizeof(h->fsm)) ||
+                h->n_nodes < 0 || NODES_MAX < h->n_nodes ||
+                h->chunk_size < 1 || SNAPSHOT_CHUNK_SIZE < h->chunk_size ||
+                h->size < 0)
+                return __corrupt(me);
+            me->nodes = calloc(h->n_nodes + 1, sizeof(snapshot_node_t));
+            me->part = realloc(me->part,
+                               h->n_nodes * sizeof(snapshot_node_t) +
+                               sizeof(snapshot_chunk_t) + h->chunk_size);
+            __expect(me, SNAPSHOT_READER_NODES,
+                     h->n_nodes * sizeof(snapshot_node_t));
+            break;
+
+        case SNAPSHOT_READER_NODES:
+            if (h->crc != __crc32(__crc32(0, (char*)h, HEADER_CRC_LEN),
+                                  me->part, me->part_len))
+                return __corrupt(me);
+            memcpy(me->nodes, me->part, me->part_len);
+            __expect(me, SNAPSHOT_READER_CHUNK_HEADER,
+                     sizeof(snapshot_chunk_t));
+            break;
+
+        case SNAPSHOT_READER_CHUNK_HEADER:
+            memcpy(&me->chunk, me->part, sizeof(me->chunk));
+            if (me->chunk.len != (h->size - me->received < h->chunk_size ?
+                                  h->size - me->received : h->chunk_size))
+                return __corrupt(me);
+            __expect(me, SNAPSHOT_READER_CHUNK, me->chunk.len);
+            break;
+
+        case SNAPSHOT_READER_CHUNK:
+            if (me->chunk.crc != __crc32(0, me->part, me->part_len) ||
+                0 != __restore(me, me->part, me->part_len))
+                return __corrupt(me);
+            me->received += me->part_len;
+            __expect(me, SNAPSHOT_READER_CHUNK_HEADER,
+                     sizeof(snapshot_chunk_t));
+            break;
+    }
+
+    /* every chunk is in */
+    if (SNAPSHOT_READER_CHUNK_HEADER == me->state && me->received == h->size)
+    {
+        if (0 != me->cmd_len || h->digest != me->ops->digest(me->fsm))
+            return __corrupt(me);
+        me->state = SNAPSHOT_READER_DONE;
+    }
+
+    return 0;
+}
+
+int snapshot_reader_write(snapshot_reader_t* me, const char* buf, int len)
+{
+    while (0 < len || (me->part_len == me->part_size &&
+                       SNAPSHOT_READER_DONE != me->state &&
+                       SNAPSHOT_READER_CORRUPT != me->state))
+    {
+        if (SNAPSHOT_READER_CORRUPT == me->state)
+            return -1;
+
+        /* nothing follows the last chunk */
+        if (SNAPSHOT_READER_DONE == me->state)
+            return __corrupt(me);
+
+        int k = me->part_size - me->part_len < len ?
+            me->part_size - me->part_len : len;
+        memcpy(me->part + me->part_len, buf, k);
+        me->part_len += k;
+        buf += k;
+        len -= k;
+
+        if (me->part_len == me->part_size && 0 != __received(me))
+            return -1;
+    }
+
+    return SNAPSHOT_READER_CORRUPT == me->state ? -1 : 0;
+}
+
+int snapshot_reader_is_done(snapshot_reader_t* me)
+{
+    return SNAPSHOT_READER_DONE == me->state;
+}
+
+void snapshot_reader_free(snapshot_reader_t* me)
+{
+    free(me->nodes);
+    free(me->part);
+    free(me->cmd);
+    free(me);
+}
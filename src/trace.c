@@ -0,0 +1,172 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "raft.h"
+#include "trace.h"
+
+/* open state span of a node, used while dumping */
+typedef struct {
+    unsigned long ts;
+    int state;
+    int term;
+    int open;
+} state_span_t;
+
+static const char* __state_name(int state)
+{
+    switch (state)
+    {
+        case RAFT_STATE_LEADER:
+            return "leader";
+        case RAFT_STATE_CANDIDATE:
+            return "candidate";
+        case RAFT_STATE_FOLLOWER:
+            return "follower";
+        default:
+            return "none";
+    }
+}
+
+trace_t* trace_new(int size)
+{
+    trace_t* me = calloc(1, sizeof(trace_t));
+    me->size = size < 1 ? 1 : size;
+    me->events = calloc(me->size, sizeof(trace_event_t));
+    return me;
+}
+
+void trace_free(trace_t* me)
+{
+    free(me->events);
+    free(me);
+}
+
+void trace_record(trace_t* me, unsigned long ts, int type, int node, int peer,
+                  int a, int b)
+{
+    trace_event_t* ev = &me->events[me->back];
+    ev->ts = ts;
+    ev->type = type;
+    ev->node = node;
+    ev->peer = peer;
+    ev->a = a;
+    ev->b = b;
+
+    if (++me->back == me->size)
+        me->back = 0;
+
+    if (me->count < me->size)
+        me->count++;
+    else
+        me->lost++;
+}
+
+static void __close_span(FILE* out, int node, state_span_t* span,
+                         unsigned long ts)
+{
+    if (!span->open)
+        return;
+    fprintf(out, ",\n{\"name\":\"%s\",\"cat\":\"state\",\"ph\":\"X\","
+            "\"ts\":%lu,\"dur\":%lu,\"pid\":0,\"tid\":%d,"
+            "\"args\":{\"term\":%d}}",
+            __state_name(span->state), span->ts, ts - span->ts, node,
+            span->term);
+    span->open = 0;
+}
+
+static const char* __msg_name(const char** msg_names, int type)
+{
+    return msg_names ? msg_names[type] : "msg";
+}
+
+void trace_dump_chrome(trace_t* me, FILE* out, int n_nodes,
+                       const char** msg_names)
+{
+    state_span_t* spans = calloc(n_nodes, sizeof(state_span_t));
+    unsigned long last_ts = 0;
+    int i;
+
+    fprintf(out, "{\"otherData\":{\"lost_events\":%ld},\"traceEvents\":[\n", me->lost);
+    fprintf(out, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,"
+            "\"args\":{\"name\":\"virtraft\"}}");
+    for (i = 0; i < n_nodes; i++)
+        fprintf(out, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,"
+                "\"tid\":%d,\"args\":{\"name\":\"server %d\"}}", i, i);
+
+    int pos = me->count < me->size ? 0 : me->back;
+    for (i = 0; i < me->count; i++, pos = (pos + 1) % me->size)
+    {
+        trace_event_t* ev = &me->events[pos];
+        last_ts = ev->ts;
+
+        if (n_nodes <= ev->node)
+            continue;
+
+        switch (ev->type)
+        {
+            case TRACE_STATE:
+                __close_span(out, ev->node, &spans[ev->node], ev->ts);
+                spans[ev->node].ts = ev->ts;
+                spans[ev->node].state = ev->a;
+                spans[ev->node].term = ev->b;
+                spans[ev->node].open = 1;
+                break;
+
+            /* flow events need an enclosing slice to bind to */
+            case TRACE_SEND:
+                fprintf(out, ",\n{\"name\":\"send %s\",\"cat\":\"msg\",\"ph\":\"X\","
+                        "\"ts\":%lu,\"dur\":1,\"pid\":0,\"tid\":%d,"
+                        "\"args\":{\"to\":%d}}",
+                        __msg_name(msg_names, ev->a), ev->ts, ev->node, ev->peer);
+                fprintf(out, ",\n{\"name\":\"%s\",\"cat\":\"msg\",\"ph\":\"s\","
+                        "\"id\":%d,\"ts\":%lu,\"pid\":0,\"tid\":%d}",
+                        __msg_name(msg_names, ev->a), ev->b, ev->ts, ev->node);
+                break;
+
+            case TRACE_RECV:
+                fprintf(out, ",\n{\"name\":\"recv %s\",\"cat\":\"msg\",\"ph\":\"X\","
+                        "\"ts\":%lu,\"dur\":1,\"pid\":0,\"tid\":%d,"
+                        "\"args\":{\"from\":%d}}",
+                        __msg_name(msg_names, ev->a), ev->ts, ev->node, ev->peer);
+                fprintf(out, ",\n{\"name\":\"%s\",\"cat\":\"msg\",\"ph\":\"f\","
+                        "\"bp\":\"e\",\"id\":%d,\"ts\":%lu,\"pid\":0,\"tid\":%d}",
+                        __msg_name(msg_names, ev->a), ev->b, ev->ts, ev->node);
+                break;
+
+            case TRACE_DROP:
+                fprintf(out, ",\n{\"name\":\"drop %s\",\"cat\":\"msg\",\"ph\":\"i\","
+                        "\"s\":\"t\",\"ts\":%lu,\"pid\":0,\"tid\":%d,"
+                        "\"args\":{\"to\":%d}}",
+                        __msg_name(msg_names, ev->a), ev->ts, ev->node, ev->peer);
+                break;
+
+            case TRACE_APPEND:
+                fprintf(out, ",\n{\"name\":\"append\",\"cat\":\"log\",\"ph\":\"i\","
+                        "\"s\":\"t\",\"ts\":%lu,\"pid\":0,\"tid\":%d,"
+                        "\"args\":{\"idx\":%d,\"term\":%d}}",
+                        ev->ts, ev->node, ev->a, ev->b);
+                break;
+
+            case TRACE_COMMIT:
+                fprintf(out, ",\n{\"name\":\"commit\",\"cat\":\"log\",\"ph\":\"i\","
+                        "\"s\":\"t\",\"ts\":%lu,\"pid\":0,\"tid\":%d,"
+                        "\"args\":{\"idx\":%d}}",
+                        ev->ts, ev->node, ev->a);
+                break;
+
+            case TRACE_APPLY:
+                fprintf(out, ",\n{\"name\":\"apply\",\"cat\":\"log\",\"ph\":\"i\","
+                        "\"s\":\"t\",\"ts\":%lu,\"pid\":0,\"tid\":%d,"
+                        "\"args\":{\"idx\":%d,\"id\":%d}}",
+                        ev->ts, ev->node, ev->a, ev->b);
+                break;
+        }
+    }
+
+    for (i = 0; i < n_nodes; i++)
+        __close_span(out, i, &spans[i], last_ts);
+
+    fprintf(out, "\n]}\n");
+    free(spans);
+}
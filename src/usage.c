@@ -12,22 +12,49 @@ typedef struct
     
 
     /* flags */
+    int check_quorum;
+    int coalesce;
     int debug;
     int help;
+    int joint;
     int no_random_period;
+    int prevote;
     int quiet;
     int tsv;
     int version;
 
     /* options */
+    char* burst_every;
+    char* burst_factor;
+    char* burst_len;
     char* client_rate;
-    char* compaction_rate;
+    char* clock_skew;
     char* drop_rate;
     char* dupe_rate;
+    char* fsm;
+    char* groups;
+    char* hot_keys;
+    char* hot_ops;
     char* iterations;
+    char* key_dist;
+    char* keys;
+    char* learner_bandwidth;
+    char* lease_drift;
     char* member_rate;
+    char* metrics;
+    char* metrics_interval;
+    char* ops_per_sec;
+    char* read_pct;
+    char* read_rate;
     char* seed;
     char* servers;
+    char* snapshot_bandwidth;
+    char* snapshot_every;
+    char* trace;
+    char* trace_size;
+    char* value_dist;
+    char* value_size;
+    char* zipf_theta;
 
     /* arguments */
     
@@ -43,84 +70,183 @@ struct params
 };
 
 
-#line 91 "src/usage.rl"
+#line 145 "src/usage.rl"
 
 
 
-#line 51 "src/usage.c"
+#line 78 "src/usage.c"
 static const char _params_actions[] = {
 	0, 1, 0, 1, 3, 1, 4, 1, 
-	5, 1, 6, 1, 7, 1, 8, 2, 
-	1, 9, 2, 1, 10, 2, 1, 11, 
-	2, 1, 12, 2, 1, 13, 2, 1, 
-	14, 2, 1, 15, 2, 1, 16, 2, 
-	2, 0
+	5, 1, 6, 1, 7, 1, 8, 1, 
+	9, 1, 10, 1, 11, 1, 12, 2, 
+	1, 13, 2, 1, 14, 2, 1, 15, 
+	2, 1, 16, 2, 1, 17, 2, 1, 
+	18, 2, 1, 19, 2, 1, 20, 2, 
+	1, 21, 2, 1, 22, 2, 1, 23, 
+	2, 1, 24, 2, 1, 25, 2, 1, 
+	26, 2, 1, 27, 2, 1, 28, 2, 
+	1, 29, 2, 1, 30, 2, 1, 31, 
+	2, 1, 32, 2, 1, 33, 2, 1, 
+	34, 2, 1, 35, 2, 1, 36, 2, 
+	1, 37, 2, 1, 38, 2, 1, 39, 
+	2, 1, 40, 2, 1, 41, 2, 1, 
+	42, 2, 1, 43, 2, 2, 0
 };
 
-static const unsigned char _params_key_offsets[] = {
+static const short _params_key_offsets[] = {
 	0, 0, 1, 5, 8, 9, 10, 11, 
 	12, 13, 14, 15, 16, 17, 18, 19, 
-	20, 21, 32, 40, 42, 43, 44, 45, 
-	46, 47, 48, 49, 50, 51, 52, 53, 
-	54, 55, 56, 57, 58, 59, 60, 61, 
-	62, 63, 64, 65, 66, 67, 68, 69, 
-	70, 73, 74, 75, 76, 77, 78, 79, 
-	80, 81, 82, 83, 84, 85, 86, 87, 
-	88, 89, 90, 91, 92, 93, 94, 95, 
-	96, 97, 98, 99, 100, 101, 102, 103, 
-	104, 105, 106, 107, 108, 109, 110, 111, 
-	112, 113, 114, 115, 116, 117, 118, 119, 
-	120, 121, 122, 123, 124, 125, 126, 127, 
+	20, 21, 32, 52, 53, 54, 55, 56, 
+	57, 60, 61, 62, 63, 64, 65, 66, 
+	67, 68, 69, 70, 71, 72, 73, 74, 
+	75, 76, 77, 78, 79, 80, 83, 84, 
+	85, 86, 87, 88, 89, 90, 91, 92, 
+	93, 94, 96, 97, 98, 99, 100, 101, 
+	102, 103, 104, 105, 106, 107, 108, 109, 
+	110, 111, 112, 113, 114, 115, 116, 117, 
+	118, 119, 120, 121, 122, 123, 124, 127, 
 	128, 129, 130, 131, 132, 133, 134, 135, 
 	136, 137, 138, 139, 140, 141, 142, 143, 
 	144, 145, 146, 147, 148, 149, 150, 151, 
 	152, 153, 154, 155, 156, 157, 158, 159, 
-	159
+	160, 161, 162, 163, 164, 165, 166, 167, 
+	169, 170, 171, 172, 173, 174, 175, 176, 
+	177, 178, 179, 180, 181, 182, 183, 184, 
+	185, 186, 187, 188, 189, 190, 191, 192, 
+	193, 194, 195, 196, 197, 198, 199, 201, 
+	202, 203, 204, 205, 206, 207, 208, 209, 
+	210, 211, 212, 213, 215, 216, 217, 218, 
+	219, 220, 221, 222, 223, 224, 225, 226, 
+	227, 228, 229, 230, 231, 232, 233, 234, 
+	235, 236, 237, 238, 239, 240, 241, 242, 
+	244, 245, 246, 247, 248, 249, 250, 251, 
+	252, 253, 254, 255, 256, 257, 258, 259, 
+	261, 262, 263, 264, 265, 266, 267, 268, 
+	269, 270, 271, 272, 273, 274, 275, 276, 
+	277, 278, 279, 280, 281, 282, 283, 284, 
+	285, 286, 287, 288, 289, 290, 291, 292, 
+	293, 294, 295, 296, 297, 298, 299, 300, 
+	301, 302, 303, 304, 305, 306, 307, 308, 
+	309, 310, 311, 312, 313, 314, 315, 316, 
+	317, 318, 319, 321, 322, 323, 324, 325, 
+	326, 327, 328, 329, 330, 331, 332, 334, 
+	335, 336, 337, 338, 339, 340, 341, 342, 
+	343, 344, 345, 346, 348, 349, 350, 351, 
+	352, 353, 354, 355, 356, 357, 358, 359, 
+	360, 361, 362, 363, 364, 365, 366, 368, 
+	369, 370, 371, 373, 374, 375, 376, 377, 
+	378, 379, 380, 381, 382, 383, 384, 385, 
+	386, 387, 388, 389, 391, 392, 393, 394, 
+	395, 396, 397, 398, 399, 400, 401, 402, 
+	403, 404, 405, 406, 407, 408, 409, 410, 
+	411, 412, 413, 414, 415, 416, 417, 418, 
+	419, 420, 421, 422, 422
 };
 
 static const char _params_trans_keys[] = {
 	45, 45, 104, 110, 118, 104, 115, 118, 
 	101, 108, 112, 0, 101, 114, 118, 101, 
-	114, 115, 0, 0, 0, 45, 67, 68, 
-	99, 100, 103, 105, 109, 112, 113, 115, 
-	99, 100, 105, 109, 110, 113, 115, 116, 
-	108, 111, 105, 101, 110, 116, 95, 114, 
-	97, 116, 101, 0, 0, 0, 109, 112, 
-	97, 99, 116, 105, 111, 110, 95, 114, 
-	97, 116, 101, 0, 0, 0, 101, 114, 
-	117, 98, 117, 103, 0, 111, 112, 95, 
-	114, 97, 116, 101, 0, 0, 0, 112, 
-	101, 95, 114, 97, 116, 101, 0, 0, 
-	0, 116, 101, 114, 97, 116, 105, 111, 
-	110, 115, 0, 0, 0, 101, 109, 98, 
-	101, 114, 95, 114, 97, 116, 101, 0, 
+	114, 115, 0, 0, 0, 45, 68, 99, 
+	100, 103, 105, 109, 112, 113, 114, 115, 
+	98, 99, 100, 102, 103, 104, 105, 106, 
+	107, 108, 109, 110, 111, 112, 113, 114, 
+	115, 116, 118, 122, 117, 114, 115, 116, 
+	95, 101, 102, 108, 118, 101, 114, 121, 
+	0, 0, 0, 97, 99, 116, 111, 114, 
+	0, 0, 0, 101, 110, 0, 0, 0, 
+	104, 108, 111, 101, 99, 107, 95, 113, 
+	117, 111, 114, 117, 109, 0, 105, 111, 
+	101, 110, 116, 95, 114, 97, 116, 101, 
+	0, 0, 0, 99, 107, 95, 115, 107, 
+	101, 119, 0, 0, 0, 97, 108, 101, 
+	115, 99, 101, 0, 101, 114, 117, 98, 
+	117, 103, 0, 111, 112, 95, 114, 97, 
+	116, 101, 0, 0, 0, 112, 101, 95, 
+	114, 97, 116, 101, 0, 0, 0, 115, 
+	109, 0, 0, 0, 114, 111, 117, 112, 
+	115, 0, 0, 0, 111, 116, 95, 107, 
+	111, 101, 121, 115, 0, 0, 0, 112, 
+	115, 0, 0, 0, 116, 101, 114, 97, 
+	116, 105, 111, 110, 115, 0, 0, 0, 
+	111, 105, 110, 116, 0, 101, 121, 95, 
+	115, 100, 105, 115, 116, 0, 0, 0, 
+	0, 0, 0, 101, 97, 114, 115, 110, 
+	101, 114, 95, 98, 97, 110, 100, 119, 
+	105, 100, 116, 104, 0, 0, 0, 101, 
+	95, 100, 114, 105, 102, 116, 0, 0, 
+	0, 101, 109, 116, 98, 101, 114, 95, 
+	114, 97, 116, 101, 0, 0, 0, 114, 
+	105, 99, 115, 0, 95, 0, 0, 105, 
+	110, 116, 101, 114, 118, 97, 108, 0, 
 	0, 0, 111, 95, 114, 97, 110, 100, 
 	111, 109, 95, 112, 101, 114, 105, 111, 
-	100, 0, 117, 105, 101, 116, 0, 101, 
-	101, 100, 0, 0, 0, 115, 118, 0, 
-	101, 114, 115, 105, 111, 110, 0, 45, 
-	0
+	100, 0, 112, 115, 95, 112, 101, 114, 
+	95, 115, 101, 99, 0, 0, 0, 114, 
+	101, 118, 111, 116, 101, 0, 117, 105, 
+	101, 116, 0, 101, 97, 100, 95, 112, 
+	114, 99, 116, 0, 0, 0, 97, 116, 
+	101, 0, 0, 0, 101, 110, 101, 100, 
+	0, 0, 0, 97, 112, 115, 104, 111, 
+	116, 95, 98, 101, 97, 110, 100, 119, 
+	105, 100, 116, 104, 0, 0, 0, 118, 
+	101, 114, 121, 0, 0, 0, 114, 115, 
+	97, 99, 101, 0, 95, 0, 0, 115, 
+	105, 122, 101, 0, 0, 0, 118, 0, 
+	97, 108, 117, 101, 95, 100, 115, 105, 
+	115, 116, 0, 0, 0, 105, 122, 101, 
+	0, 0, 0, 105, 112, 102, 95, 116, 
+	104, 101, 116, 97, 0, 0, 0, 101, 
+	114, 115, 105, 111, 110, 0, 45, 0
 };
 
 static const char _params_single_lengths[] = {
 	0, 1, 4, 3, 1, 1, 1, 1, 
 	1, 1, 1, 1, 1, 1, 1, 1, 
-	1, 11, 8, 2, 1, 1, 1, 1, 
+	1, 11, 20, 1, 1, 1, 1, 1, 
+	3, 1, 1, 1, 1, 1, 1, 1, 
+	1, 1, 1, 1, 1, 1, 1, 1, 
+	1, 1, 1, 1, 1, 3, 1, 1, 
+	1, 1, 1, 1, 1, 1, 1, 1, 
+	1, 2, 1, 1, 1, 1, 1, 1, 
+	1, 1, 1, 1, 1, 1, 1, 1, 
+	1, 1, 1, 1, 1, 1, 1, 1, 
+	1, 1, 1, 1, 1, 1, 3, 1, 
+	1, 1, 1, 1, 1, 1, 1, 1, 
+	1, 1, 1, 1, 1, 1, 1, 1, 
+	1, 1, 1, 1, 1, 1, 1, 1, 
+	1, 1, 1, 1, 1, 1, 1, 1, 
+	1, 1, 1, 1, 1, 1, 1, 2, 
+	1, 1, 1, 1, 1, 1, 1, 1, 
+	1, 1, 1, 1, 1, 1, 1, 1, 
+	1, 1, 1, 1, 1, 1, 1, 1, 
+	1, 1, 1, 1, 1, 1, 2, 1, 
+	1, 1, 1, 1, 1, 1, 1, 1, 
+	1, 1, 1, 2, 1, 1, 1, 1, 
+	1, 1, 1, 1, 1, 1, 1, 1, 
+	1, 1, 1, 1, 1, 1, 1, 1, 
+	1, 1, 1, 1, 1, 1, 1, 2, 
+	1, 1, 1, 1, 1, 1, 1, 1, 
+	1, 1, 1, 1, 1, 1, 1, 2, 
 	1, 1, 1, 1, 1, 1, 1, 1, 
 	1, 1, 1, 1, 1, 1, 1, 1, 
 	1, 1, 1, 1, 1, 1, 1, 1, 
-	3, 1, 1, 1, 1, 1, 1, 1, 
 	1, 1, 1, 1, 1, 1, 1, 1, 
 	1, 1, 1, 1, 1, 1, 1, 1, 
 	1, 1, 1, 1, 1, 1, 1, 1, 
 	1, 1, 1, 1, 1, 1, 1, 1, 
+	1, 1, 2, 1, 1, 1, 1, 1, 
+	1, 1, 1, 1, 1, 1, 2, 1, 
 	1, 1, 1, 1, 1, 1, 1, 1, 
+	1, 1, 1, 2, 1, 1, 1, 1, 
 	1, 1, 1, 1, 1, 1, 1, 1, 
+	1, 1, 1, 1, 1, 1, 2, 1, 
+	1, 1, 2, 1, 1, 1, 1, 1, 
 	1, 1, 1, 1, 1, 1, 1, 1, 
+	1, 1, 1, 2, 1, 1, 1, 1, 
 	1, 1, 1, 1, 1, 1, 1, 1, 
 	1, 1, 1, 1, 1, 1, 1, 1, 
-	1, 1, 1, 1, 1, 1, 1, 0, 
-	1
+	1, 1, 1, 1, 1, 1, 1, 1, 
+	1, 1, 1, 0, 1
 };
 
 static const char _params_range_lengths[] = {
@@ -141,120 +267,302 @@ static const char _params_range_lengths[] = {
 	0, 0, 0, 0, 0, 0, 0, 0, 
 	0, 0, 0, 0, 0, 0, 0, 0, 
 	0, 0, 0, 0, 0, 0, 0, 0, 
-	0
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0
 };
 
 static const short _params_index_offsets[] = {
 	0, 0, 2, 7, 11, 13, 15, 17, 
 	19, 21, 23, 25, 27, 29, 31, 33, 
-	35, 37, 49, 58, 61, 63, 65, 67, 
-	69, 71, 73, 75, 77, 79, 81, 83, 
-	85, 87, 89, 91, 93, 95, 97, 99, 
-	101, 103, 105, 107, 109, 111, 113, 115, 
-	117, 121, 123, 125, 127, 129, 131, 133, 
-	135, 137, 139, 141, 143, 145, 147, 149, 
-	151, 153, 155, 157, 159, 161, 163, 165, 
-	167, 169, 171, 173, 175, 177, 179, 181, 
-	183, 185, 187, 189, 191, 193, 195, 197, 
-	199, 201, 203, 205, 207, 209, 211, 213, 
+	35, 37, 49, 70, 72, 74, 76, 78, 
+	80, 84, 86, 88, 90, 92, 94, 96, 
+	98, 100, 102, 104, 106, 108, 110, 112, 
+	114, 116, 118, 120, 122, 124, 128, 130, 
+	132, 134, 136, 138, 140, 142, 144, 146, 
+	148, 150, 153, 155, 157, 159, 161, 163, 
+	165, 167, 169, 171, 173, 175, 177, 179, 
+	181, 183, 185, 187, 189, 191, 193, 195, 
+	197, 199, 201, 203, 205, 207, 209, 213, 
 	215, 217, 219, 221, 223, 225, 227, 229, 
 	231, 233, 235, 237, 239, 241, 243, 245, 
 	247, 249, 251, 253, 255, 257, 259, 261, 
 	263, 265, 267, 269, 271, 273, 275, 277, 
 	279, 281, 283, 285, 287, 289, 291, 293, 
-	294
+	296, 298, 300, 302, 304, 306, 308, 310, 
+	312, 314, 316, 318, 320, 322, 324, 326, 
+	328, 330, 332, 334, 336, 338, 340, 342, 
+	344, 346, 348, 350, 352, 354, 356, 359, 
+	361, 363, 365, 367, 369, 371, 373, 375, 
+	377, 379, 381, 383, 386, 388, 390, 392, 
+	394, 396, 398, 400, 402, 404, 406, 408, 
+	410, 412, 414, 416, 418, 420, 422, 424, 
+	426, 428, 430, 432, 434, 436, 438, 440, 
+	443, 445, 447, 449, 451, 453, 455, 457, 
+	459, 461, 463, 465, 467, 469, 471, 473, 
+	476, 478, 480, 482, 484, 486, 488, 490, 
+	492, 494, 496, 498, 500, 502, 504, 506, 
+	508, 510, 512, 514, 516, 518, 520, 522, 
+	524, 526, 528, 530, 532, 534, 536, 538, 
+	540, 542, 544, 546, 548, 550, 552, 554, 
+	556, 558, 560, 562, 564, 566, 568, 570, 
+	572, 574, 576, 578, 580, 582, 584, 586, 
+	588, 590, 592, 595, 597, 599, 601, 603, 
+	605, 607, 609, 611, 613, 615, 617, 620, 
+	622, 624, 626, 628, 630, 632, 634, 636, 
+	638, 640, 642, 644, 647, 649, 651, 653, 
+	655, 657, 659, 661, 663, 665, 667, 669, 
+	671, 673, 675, 677, 679, 681, 683, 686, 
+	688, 690, 692, 695, 697, 699, 701, 703, 
+	705, 707, 709, 711, 713, 715, 717, 719, 
+	721, 723, 725, 727, 730, 732, 734, 736, 
+	738, 740, 742, 744, 746, 748, 750, 752, 
+	754, 756, 758, 760, 762, 764, 766, 768, 
+	770, 772, 774, 776, 778, 780, 782, 784, 
+	786, 788, 790, 792, 793
 };
 
-static const unsigned char _params_trans_targs[] = {
-	2, 0, 3, 7, 14, 134, 0, 4, 
-	8, 128, 0, 5, 0, 6, 0, 7, 
-	0, 135, 0, 9, 0, 10, 0, 11, 
+static const short _params_trans_targs[] = {
+	2, 0, 3, 7, 14, 370, 0, 4, 
+	8, 364, 0, 5, 0, 6, 0, 7, 
+	0, 371, 0, 9, 0, 10, 0, 11, 
 	0, 12, 0, 13, 0, 14, 0, 15, 
-	0, 0, 16, 136, 16, 18, 45, 70, 
-	29, 60, 52, 82, 95, 113, 118, 122, 
-	0, 19, 48, 73, 85, 98, 114, 119, 
-	125, 0, 20, 32, 0, 21, 0, 22, 
-	0, 23, 0, 24, 0, 25, 0, 26, 
-	0, 27, 0, 28, 0, 29, 0, 30, 
-	0, 0, 31, 136, 31, 33, 0, 34, 
-	0, 35, 0, 36, 0, 37, 0, 38, 
-	0, 39, 0, 40, 0, 41, 0, 42, 
-	0, 43, 0, 44, 0, 45, 0, 46, 
-	0, 0, 47, 136, 47, 49, 53, 63, 
-	0, 50, 0, 51, 0, 52, 0, 136, 
-	0, 54, 0, 55, 0, 56, 0, 57, 
-	0, 58, 0, 59, 0, 60, 0, 61, 
-	0, 0, 62, 136, 62, 64, 0, 65, 
-	0, 66, 0, 67, 0, 68, 0, 69, 
-	0, 70, 0, 71, 0, 0, 72, 136, 
-	72, 74, 0, 75, 0, 76, 0, 77, 
-	0, 78, 0, 79, 0, 80, 0, 81, 
-	0, 82, 0, 83, 0, 0, 84, 136, 
-	84, 86, 0, 87, 0, 88, 0, 89, 
-	0, 90, 0, 91, 0, 92, 0, 93, 
-	0, 94, 0, 95, 0, 96, 0, 0, 
-	97, 136, 97, 99, 0, 100, 0, 101, 
-	0, 102, 0, 103, 0, 104, 0, 105, 
+	0, 0, 16, 372, 16, 18, 108, 66, 
+	98, 90, 148, 208, 244, 269, 283, 289, 
+	0, 19, 45, 86, 111, 116, 124, 139, 
+	151, 156, 169, 198, 229, 245, 258, 265, 
+	270, 286, 318, 334, 352, 0, 20, 0, 
+	21, 0, 22, 0, 23, 0, 24, 0, 
+	25, 32, 40, 0, 26, 0, 27, 0, 
+	28, 0, 29, 0, 30, 0, 0, 31, 
+	372, 31, 33, 0, 34, 0, 35, 0, 
+	36, 0, 37, 0, 38, 0, 0, 39, 
+	372, 39, 41, 0, 42, 0, 43, 0, 
+	0, 44, 372, 44, 46, 57, 79, 0, 
+	47, 0, 48, 0, 49, 0, 50, 0, 
+	51, 0, 52, 0, 53, 0, 54, 0, 
+	55, 0, 56, 0, 372, 0, 58, 69, 
+	0, 59, 0, 60, 0, 61, 0, 62, 
+	0, 63, 0, 64, 0, 65, 0, 66, 
+	0, 67, 0, 0, 68, 372, 68, 70, 
+	0, 71, 0, 72, 0, 73, 0, 74, 
+	0, 75, 0, 76, 0, 77, 0, 0, 
+	78, 372, 78, 80, 0, 81, 0, 82, 
+	0, 83, 0, 84, 0, 85, 0, 372, 
+	0, 87, 91, 101, 0, 88, 0, 89, 
+	0, 90, 0, 372, 0, 92, 0, 93, 
+	0, 94, 0, 95, 0, 96, 0, 97, 
+	0, 98, 0, 99, 0, 0, 100, 372, 
+	100, 102, 0, 103, 0, 104, 0, 105, 
 	0, 106, 0, 107, 0, 108, 0, 109, 
-	0, 110, 0, 111, 0, 112, 0, 113, 
-	0, 136, 0, 115, 0, 116, 0, 117, 
-	0, 118, 0, 136, 0, 120, 0, 121, 
-	0, 122, 0, 123, 0, 0, 124, 136, 
-	124, 126, 0, 127, 0, 136, 0, 129, 
-	0, 130, 0, 131, 0, 132, 0, 133, 
-	0, 134, 0, 135, 0, 0, 17, 0, 
-	0
+	0, 0, 110, 372, 110, 112, 0, 113, 
+	0, 114, 0, 0, 115, 372, 115, 117, 
+	0, 118, 0, 119, 0, 120, 0, 121, 
+	0, 122, 0, 0, 123, 372, 123, 125, 
+	0, 126, 0, 127, 0, 128, 134, 0, 
+	129, 0, 130, 0, 131, 0, 132, 0, 
+	0, 133, 372, 133, 135, 0, 136, 0, 
+	137, 0, 0, 138, 372, 138, 140, 0, 
+	141, 0, 142, 0, 143, 0, 144, 0, 
+	145, 0, 146, 0, 147, 0, 148, 0, 
+	149, 0, 0, 150, 372, 150, 152, 0, 
+	153, 0, 154, 0, 155, 0, 372, 0, 
+	157, 0, 158, 0, 159, 166, 0, 160, 
+	0, 161, 0, 162, 0, 163, 0, 164, 
+	0, 0, 165, 372, 165, 167, 0, 0, 
+	168, 372, 168, 170, 0, 171, 0, 172, 
+	188, 0, 173, 0, 174, 0, 175, 0, 
+	176, 0, 177, 0, 178, 0, 179, 0, 
+	180, 0, 181, 0, 182, 0, 183, 0, 
+	184, 0, 185, 0, 186, 0, 0, 187, 
+	372, 187, 189, 0, 190, 0, 191, 0, 
+	192, 0, 193, 0, 194, 0, 195, 0, 
+	196, 0, 0, 197, 372, 197, 199, 0, 
+	200, 211, 0, 201, 0, 202, 0, 203, 
+	0, 204, 0, 205, 0, 206, 0, 207, 
+	0, 208, 0, 209, 0, 0, 210, 372, 
+	210, 212, 0, 213, 0, 214, 0, 215, 
+	0, 216, 218, 0, 0, 217, 372, 217, 
+	219, 0, 220, 0, 221, 0, 222, 0, 
+	223, 0, 224, 0, 225, 0, 226, 0, 
+	227, 0, 0, 228, 372, 228, 230, 0, 
+	231, 0, 232, 0, 233, 0, 234, 0, 
+	235, 0, 236, 0, 237, 0, 238, 0, 
+	239, 0, 240, 0, 241, 0, 242, 0, 
+	243, 0, 244, 0, 372, 0, 246, 0, 
+	247, 0, 248, 0, 249, 0, 250, 0, 
+	251, 0, 252, 0, 253, 0, 254, 0, 
+	255, 0, 256, 0, 0, 257, 372, 257, 
+	259, 0, 260, 0, 261, 0, 262, 0, 
+	263, 0, 264, 0, 372, 0, 266, 0, 
+	267, 0, 268, 0, 269, 0, 372, 0, 
+	271, 0, 272, 0, 273, 0, 274, 0, 
+	275, 280, 0, 276, 0, 277, 0, 278, 
+	0, 0, 279, 372, 279, 281, 0, 282, 
+	0, 283, 0, 284, 0, 0, 285, 372, 
+	285, 287, 292, 0, 288, 0, 289, 0, 
+	290, 0, 0, 291, 372, 291, 293, 0, 
+	294, 0, 295, 0, 296, 0, 297, 0, 
+	298, 0, 299, 0, 300, 311, 0, 301, 
+	0, 302, 0, 303, 0, 304, 0, 305, 
+	0, 306, 0, 307, 0, 308, 0, 309, 
+	0, 0, 310, 372, 310, 312, 0, 313, 
+	0, 314, 0, 315, 0, 316, 0, 0, 
+	317, 372, 317, 319, 332, 0, 320, 0, 
+	321, 0, 322, 0, 323, 325, 0, 0, 
+	324, 372, 324, 326, 0, 327, 0, 328, 
+	0, 329, 0, 330, 0, 0, 331, 372, 
+	331, 333, 0, 372, 0, 335, 0, 336, 
+	0, 337, 0, 338, 0, 339, 0, 340, 
+	346, 0, 341, 0, 342, 0, 343, 0, 
+	344, 0, 0, 345, 372, 345, 347, 0, 
+	348, 0, 349, 0, 350, 0, 0, 351, 
+	372, 351, 353, 0, 354, 0, 355, 0, 
+	356, 0, 357, 0, 358, 0, 359, 0, 
+	360, 0, 361, 0, 362, 0, 0, 363, 
+	372, 363, 365, 0, 366, 0, 367, 0, 
+	368, 0, 369, 0, 370, 0, 371, 0, 
+	0, 17, 0, 0
 };
 
 static const char _params_trans_actions[] = {
 	0, 0, 0, 0, 0, 0, 0, 0, 
 	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 5, 0, 0, 0, 0, 0, 0, 
+	0, 9, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 116, 92, 1, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
 	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 39, 36, 1, 0, 0, 0, 
 	0, 0, 0, 0, 0, 0, 0, 0, 
 	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 116, 
+	23, 1, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 116, 
+	26, 1, 0, 0, 0, 0, 0, 0, 
+	0, 116, 29, 1, 0, 0, 0, 0, 
 	0, 0, 0, 0, 0, 0, 0, 0, 
 	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 3, 0, 0, 0, 
 	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 39, 15, 1, 0, 0, 0, 
 	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 116, 32, 1, 0, 
 	0, 0, 0, 0, 0, 0, 0, 0, 
 	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 39, 18, 1, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 3, 
+	116, 35, 1, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 5, 
 	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 7, 0, 0, 0, 0, 
 	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 39, 21, 1, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 116, 38, 
+	1, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 116, 41, 1, 0, 0, 0, 
+	0, 0, 0, 0, 116, 44, 1, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 116, 47, 1, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 116, 50, 1, 0, 0, 0, 0, 
+	0, 0, 0, 116, 53, 1, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 116, 56, 1, 0, 0, 
+	0, 0, 0, 0, 0, 0, 11, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 116, 59, 1, 0, 0, 0, 
+	116, 62, 1, 0, 0, 0, 0, 0, 
 	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 39, 24, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 116, 
+	65, 1, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 116, 68, 1, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 116, 71, 
 	1, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0, 116, 74, 1, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 116, 77, 1, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
 	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 39, 27, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 13, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0, 116, 80, 1, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 15, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 17, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 116, 83, 1, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 116, 86, 
 	1, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 116, 89, 1, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 0, 
 	0, 0, 0, 0, 0, 0, 0, 0, 
+	0, 0, 116, 95, 1, 0, 0, 0, 
 	0, 0, 0, 0, 0, 0, 0, 0, 
-	39, 30, 1, 0, 0, 0, 0, 0, 
+	116, 98, 1, 0, 0, 0, 0, 0, 
 	0, 0, 0, 0, 0, 0, 0, 0, 
+	116, 101, 1, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 116, 104, 
+	1, 0, 0, 19, 0, 0, 0, 0, 
 	0, 0, 0, 0, 0, 0, 0, 0, 
 	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 7, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 9, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 39, 33, 
-	1, 0, 0, 0, 0, 11, 0, 0, 
+	0, 0, 0, 116, 107, 1, 0, 0, 
+	0, 0, 0, 0, 0, 0, 0, 116, 
+	110, 1, 0, 0, 0, 0, 0, 0, 
 	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 13, 0, 0, 0, 0, 
-	0
+	0, 0, 0, 0, 0, 0, 0, 116, 
+	113, 1, 0, 0, 0, 0, 0, 0, 
+	0, 0, 0, 0, 0, 0, 21, 0, 
+	0, 0, 0, 0
 };
 
 static const int params_start = 1;
-static const int params_first_final = 135;
+static const int params_first_final = 371;
 static const int params_error = 0;
 
 static const int params_en_main = 1;
 
 
-#line 94 "src/usage.rl"
+#line 148 "src/usage.rl"
 
 static void params_init(struct params *fsm, options_t* opt)
 {
@@ -262,21 +570,37 @@ static void params_init(struct params *fsm, options_t* opt)
 
     fsm->opt = opt;
     fsm->buflen = 0;
+    fsm->opt->burst_factor = strdup("10");
+    fsm->opt->burst_len = strdup("20");
     fsm->opt->client_rate = strdup("100");
-    fsm->opt->compaction_rate = strdup("0");
+    fsm->opt->clock_skew = strdup("0");
     fsm->opt->drop_rate = strdup("0");
     fsm->opt->dupe_rate = strdup("0");
+    fsm->opt->fsm = strdup("kvstore");
+    fsm->opt->groups = strdup("1");
+    fsm->opt->hot_keys = strdup("1");
+    fsm->opt->hot_ops = strdup("90");
     fsm->opt->iterations = strdup("-1");
+    fsm->opt->key_dist = strdup("uniform");
+    fsm->opt->keys = strdup("1000");
     fsm->opt->member_rate = strdup("0");
+    fsm->opt->metrics_interval = strdup("1000");
+    fsm->opt->read_pct = strdup("0");
+    fsm->opt->read_rate = strdup("0");
     fsm->opt->seed = strdup("0");
+    fsm->opt->snapshot_bandwidth = strdup("10000000");
+    fsm->opt->trace_size = strdup("1000000");
+    fsm->opt->value_dist = strdup("fixed");
+    fsm->opt->value_size = strdup("64");
+    fsm->opt->zipf_theta = strdup("0.99");
 
     
-#line 275 "src/usage.c"
+#line 599 "src/usage.c"
 	{
 	 fsm->cs = params_start;
 	}
 
-#line 110 "src/usage.rl"
+#line 180 "src/usage.rl"
 }
 
 static void params_execute(struct params *fsm, const char *data, int len)
@@ -285,7 +609,7 @@ static void params_execute(struct params *fsm, const char *data, int len)
     const char *pe = data + len;
 
     
-#line 289 "src/usage.c"
+#line 613 "src/usage.c"
 	{
 	int _klen;
 	unsigned int _trans;
@@ -359,80 +683,188 @@ _match:
 		switch ( *_acts++ )
 		{
 	case 0:
-#line 47 "src/usage.rl"
+#line 74 "src/usage.rl"
 	{
         if (fsm->buflen < BUFLEN)
             fsm->buffer[fsm->buflen++] = (*p);
     }
 	break;
 	case 1:
-#line 52 "src/usage.rl"
+#line 79 "src/usage.rl"
 	{
         if (fsm->buflen < BUFLEN)
             fsm->buffer[fsm->buflen++] = 0;
     }
 	break;
 	case 2:
-#line 57 "src/usage.rl"
+#line 84 "src/usage.rl"
 	{ fsm->buflen = 0; }
 	break;
 	case 3:
-#line 60 "src/usage.rl"
-	{ fsm->opt->debug = 1; }
+#line 87 "src/usage.rl"
+	{ fsm->opt->check_quorum = 1; }
 	break;
 	case 4:
-#line 61 "src/usage.rl"
-	{ fsm->opt->help = 1; }
+#line 88 "src/usage.rl"
+	{ fsm->opt->coalesce = 1; }
 	break;
 	case 5:
-#line 62 "src/usage.rl"
-	{ fsm->opt->no_random_period = 1; }
+#line 89 "src/usage.rl"
+	{ fsm->opt->debug = 1; }
 	break;
 	case 6:
-#line 63 "src/usage.rl"
-	{ fsm->opt->quiet = 1; }
+#line 90 "src/usage.rl"
+	{ fsm->opt->help = 1; }
 	break;
 	case 7:
-#line 64 "src/usage.rl"
-	{ fsm->opt->tsv = 1; }
+#line 91 "src/usage.rl"
+	{ fsm->opt->joint = 1; }
 	break;
 	case 8:
-#line 65 "src/usage.rl"
-	{ fsm->opt->version = 1; }
+#line 92 "src/usage.rl"
+	{ fsm->opt->no_random_period = 1; }
 	break;
 	case 9:
-#line 66 "src/usage.rl"
-	{ fsm->opt->client_rate = strdup(fsm->buffer); }
+#line 93 "src/usage.rl"
+	{ fsm->opt->prevote = 1; }
 	break;
 	case 10:
-#line 67 "src/usage.rl"
-	{ fsm->opt->compaction_rate = strdup(fsm->buffer); }
+#line 94 "src/usage.rl"
+	{ fsm->opt->quiet = 1; }
 	break;
 	case 11:
-#line 68 "src/usage.rl"
-	{ fsm->opt->drop_rate = strdup(fsm->buffer); }
+#line 95 "src/usage.rl"
+	{ fsm->opt->tsv = 1; }
 	break;
 	case 12:
-#line 69 "src/usage.rl"
-	{ fsm->opt->dupe_rate = strdup(fsm->buffer); }
+#line 96 "src/usage.rl"
+	{ fsm->opt->version = 1; }
 	break;
 	case 13:
-#line 70 "src/usage.rl"
-	{ fsm->opt->iterations = strdup(fsm->buffer); }
+#line 97 "src/usage.rl"
+	{ fsm->opt->burst_every = strdup(fsm->buffer); }
 	break;
 	case 14:
-#line 71 "src/usage.rl"
-	{ fsm->opt->member_rate = strdup(fsm->buffer); }
+#line 98 "src/usage.rl"
+	{ fsm->opt->burst_factor = strdup(fsm->buffer); }
 	break;
 	case 15:
-#line 72 "src/usage.rl"
-	{ fsm->opt->seed = strdup(fsm->buffer); }
+#line 99 "src/usage.rl"
+	{ fsm->opt->burst_len = strdup(fsm->buffer); }
 	break;
 	case 16:
-#line 73 "src/usage.rl"
+#line 100 "src/usage.rl"
+	{ fsm->opt->client_rate = strdup(fsm->buffer); }
+	break;
+	case 17:
+#line 101 "src/usage.rl"
+	{ fsm->opt->clock_skew = strdup(fsm->buffer); }
+	break;
+	case 18:
+#line 102 "src/usage.rl"
+	{ fsm->opt->drop_rate = strdup(fsm->buffer); }
+	break;
+	case 19:
+#line 103 "src/usage.rl"
+	{ fsm->opt->dupe_rate = strdup(fsm->buffer); }
+	break;
+	case 20:
+#line 104 "src/usage.rl"
+	{ fsm->opt->fsm = strdup(fsm->buffer); }
+	break;
+	case 21:
+#line 105 "src/usage.rl"
+	{ fsm->opt->groups = strdup(fsm->buffer); }
+	break;
+	case 22:
+#line 106 "src/usage.rl"
+	{ fsm->opt->hot_keys = strdup(fsm->buffer); }
+	break;
+	case 23:
+#line 107 "src/usage.rl"
+	{ fsm->opt->hot_ops = strdup(fsm->buffer); }
+	break;
+	case 24:
+#line 108 "src/usage.rl"
+	{ fsm->opt->iterations = strdup(fsm->buffer); }
+	break;
+	case 25:
+#line 109 "src/usage.rl"
+	{ fsm->opt->key_dist = strdup(fsm->buffer); }
+	break;
+	case 26:
+#line 110 "src/usage.rl"
+	{ fsm->opt->keys = strdup(fsm->buffer); }
+	break;
+	case 27:
+#line 111 "src/usage.rl"
+	{ fsm->opt->learner_bandwidth = strdup(fsm->buffer); }
+	break;
+	case 28:
+#line 112 "src/usage.rl"
+	{ fsm->opt->lease_drift = strdup(fsm->buffer); }
+	break;
+	case 29:
+#line 113 "src/usage.rl"
+	{ fsm->opt->member_rate = strdup(fsm->buffer); }
+	break;
+	case 30:
+#line 114 "src/usage.rl"
+	{ fsm->opt->metrics = strdup(fsm->buffer); }
+	break;
+	case 31:
+#line 115 "src/usage.rl"
+	{ fsm->opt->metrics_interval = strdup(fsm->buffer); }
+	break;
+	case 32:
+#line 116 "src/usage.rl"
+	{ fsm->opt->ops_per_sec = strdup(fsm->buffer); }
+	break;
+	case 33:
+#line 117 "src/usage.rl"
+	{ fsm->opt->read_pct = strdup(fsm->buffer); }
+	break;
+	case 34:
+#line 118 "src/usage.rl"
+	{ fsm->opt->read_rate = strdup(fsm->buffer); }
+	break;
+	case 35:
+#line 119 "src/usage.rl"
+	{ fsm->opt->seed = strdup(fsm->buffer); }
+	break;
+	case 36:
+#line 120 "src/usage.rl"
 	{ fsm->opt->servers = strdup(fsm->buffer); }
 	break;
-#line 436 "src/usage.c"
+	case 37:
+#line 121 "src/usage.rl"
+	{ fsm->opt->snapshot_bandwidth = strdup(fsm->buffer); }
+	break;
+	case 38:
+#line 122 "src/usage.rl"
+	{ fsm->opt->snapshot_every = strdup(fsm->buffer); }
+	break;
+	case 39:
+#line 123 "src/usage.rl"
+	{ fsm->opt->trace = strdup(fsm->buffer); }
+	break;
+	case 40:
+#line 124 "src/usage.rl"
+	{ fsm->opt->trace_size = strdup(fsm->buffer); }
+	break;
+	case 41:
+#line 125 "src/usage.rl"
+	{ fsm->opt->value_dist = strdup(fsm->buffer); }
+	break;
+	case 42:
+#line 126 "src/usage.rl"
+	{ fsm->opt->value_size = strdup(fsm->buffer); }
+	break;
+	case 43:
+#line 127 "src/usage.rl"
+	{ fsm->opt->zipf_theta = strdup(fsm->buffer); }
+	break;
+#line 868 "src/usage.c"
 		}
 	}
 
@@ -445,7 +877,7 @@ _again:
 	_out: {}
 	}
 
-#line 118 "src/usage.rl"
+#line 188 "src/usage.rl"
 }
 
 static int params_finish(struct params *fsm)
@@ -462,31 +894,64 @@ static void show_usage()
     fprintf(stdout, "virtraft - test raft\n");
     fprintf(stdout, "\n");
     fprintf(stdout, "Usage:\n");
-    fprintf(stdout, "  virtraft --servers SERVERS [-d RATE | -D RATE | -c RATE | -C RATE | -m RATE | -s SEED | -i ITERS | -p | --tsv | -q | --debug]\n");
+    fprintf(stdout, "  virtraft --servers SERVERS [-d RATE | -D RATE | -c RATE | -r RATE | -m RATE | --fsm FSM | --keys KEYS | --value_size BYTES | --value_dist DIST | --ops_per_sec OPS | --read_pct PCT | --key_dist DIST | --zipf_theta THETA | --hot_keys PCT | --hot_ops PCT | --burst_every ITERS | --burst_len ITERS | --burst_factor FACTOR | --snapshot_every ENTRIES | --snapshot_bandwidth BYTES | -s SEED | -i ITERS | -p | --tsv | --metrics FILE | --metrics_interval ITERS | --trace FILE | --trace_size EVENTS | --prevote | --check_quorum | --groups GROUPS | --coalesce | --joint | --learner_bandwidth BYTES | --lease_drift PCT | --clock_skew PCT | -q | --debug]\n");
     fprintf(stdout, "  virtraft --version\n");
     fprintf(stdout, "  virtraft --help\n");
     fprintf(stdout, "\n");
     fprintf(stdout, "Options:\n");
-    fprintf(stdout, "  -n --servers SERVERS       Number of servers\n");
-    fprintf(stdout, "  -d --drop_rate RATE        Message drop rate 0-100 [default: 0]\n");
-    fprintf(stdout, "  -D --dupe_rate RATE        Message duplication rate 0-100 [default: 0]\n");
-    fprintf(stdout, "  -c --client_rate RATE      Rate entries are received from the client 0-100 [default: 100]\n");
-    fprintf(stdout, "  -C --compaction_rate RATE  Rate that log compactions occur 0-100 [default: 0]\n");
-    fprintf(stdout, "  -m --member_rate RATE      Membership change rate 0-100 [default: 0]\n");
-    fprintf(stdout, "  -p --no_random_period      Don't use a random period\n");
-    fprintf(stdout, "  -s --seed SEED             The simulation's seed [default: 0]\n");
-    fprintf(stdout, "  -q --quiet                 No output at end of run\n");
-    fprintf(stdout, "  -i --iterations ITERS      Number of iterations before the simulation ends [default: -1]\n");
-    fprintf(stdout, "  --tsv                      Output node status tab separated values at exit\n");
-    fprintf(stdout, "  -g --debug                 Show debug logs\n");
-    fprintf(stdout, "  -v --version               Display version.\n");
-    fprintf(stdout, "  -h --help                  Prints a short usage summary.\n");
+    fprintf(stdout, "  -n --servers SERVERS        Number of servers\n");
+    fprintf(stdout, "  -d --drop_rate RATE         Message drop rate 0-100 [default: 0]\n");
+    fprintf(stdout, "  -D --dupe_rate RATE         Message duplication rate 0-100 [default: 0]\n");
+    fprintf(stdout, "  -c --client_rate RATE       Rate entries are received from the client; over 100 for several per iteration [default: 100]\n");
+    fprintf(stdout, "  -r --read_rate RATE         Rate reads are received from the client; over 100 for several per iteration [default: 0]\n");
+    fprintf(stdout, "  -m --member_rate RATE       Membership change rate 0-100000 [default: 0]\n");
+    fprintf(stdout, "  --fsm FSM                   State machine every server runs: simple, kvstore or heavy [default: kvstore]\n");
+    fprintf(stdout, "  --keys KEYS                 Number of keys, or cells, client commands pick from [default: 1000]\n");
+    fprintf(stdout, "  --value_size BYTES          Mean size of the values client commands set [default: 64]\n");
+    fprintf(stdout, "  --value_dist DIST           How value sizes vary: fixed, uniform or exp [default: fixed]\n");
+    fprintf(stdout, "  --ops_per_sec OPS           Client operations arriving per virtual second as a Poisson process, however fast they're served; replaces -c and -r\n");
+    fprintf(stdout, "  --read_pct PCT              Percentage of --ops_per_sec operations that are reads [default: 0]\n");
+    fprintf(stdout, "  --key_dist DIST             How client operations pick keys: uniform, zipf or hotspot [default: uniform]\n");
+    fprintf(stdout, "  --zipf_theta THETA          Skew of the zipf key distribution; 0 is uniform [default: 0.99]\n");
+    fprintf(stdout, "  --hot_keys PCT              Percentage of keys that are hot [default: 1]\n");
+    fprintf(stdout, "  --hot_ops PCT               Percentage of hotspot operations that go to hot keys [default: 90]\n");
+    fprintf(stdout, "  --burst_every ITERS         Start a burst every ITERS iterations, in which operations arrive --burst_factor times as often and all go to hot keys\n");
+    fprintf(stdout, "  --burst_len ITERS           Iterations a burst lasts [default: 20]\n");
+    fprintf(stdout, "  --burst_factor FACTOR       How many times as often operations arrive in a burst [default: 10]\n");
+    fprintf(stdout, "  --snapshot_every ENTRIES    Snapshot each server's state machine every ENTRIES applied entries, and compact its log\n");
+    fprintf(stdout, "  --snapshot_bandwidth BYTES  Bytes per second a server saves or sends a snapshot at [default: 10000000]\n");
+    fprintf(stdout, "  -p --no_random_period       Don't use a random period\n");
+    fprintf(stdout, "  -s --seed SEED              The simulation's seed [default: 0]\n");
+    fprintf(stdout, "  -q --quiet                  No output at end of run\n");
+    fprintf(stdout, "  -i --iterations ITERS       Number of iterations before the simulation ends [default: -1]\n");
+    fprintf(stdout, "  --tsv                       Output node status tab separated values at exit\n");
+    fprintf(stdout, "  --metrics FILE              Stream tab separated metrics rows to FILE\n");
+    fprintf(stdout, "  --metrics_interval ITERS    Iterations between metrics rows [default: 1000]\n");
+    fprintf(stdout, "  --trace FILE                Write a Chrome trace of the run to FILE at exit or on failure\n");
+    fprintf(stdout, "  --trace_size EVENTS         Number of most recent events the trace keeps [default: 1000000]\n");
+    fprintf(stdout, "  --prevote                   Run a pre-vote round before becoming a candidate\n");
+    fprintf(stdout, "  --check_quorum              Leaders step down when a majority stops responding\n");
+    fprintf(stdout, "  --groups GROUPS             Raft groups run by each server; extra groups are idle and need a static membership [default: 1]\n");
+    fprintf(stdout, "  --coalesce                  Send a server's messages to each peer as one packet per iteration\n");
+    fprintf(stdout, "  --joint                     Swap every pending member in one joint configuration change\n");
+    fprintf(stdout, "  --learner_bandwidth BYTES   Bytes of entries per second a leader sends its non-voting servers\n");
+    fprintf(stdout, "  --lease_drift PCT           Serve reads from a leader lease, assuming clock rates differ by at most PCT percent\n");
+    fprintf(stdout, "  --clock_skew PCT            Make each server's clock run up to PCT percent fast or slow [default: 0]\n");
+    fprintf(stdout, "  -g --debug                  Show debug logs\n");
+    fprintf(stdout, "  -v --version                Display version.\n");
+    fprintf(stdout, "  -h --help                   Prints a short usage summary.\n");
     fprintf(stdout, "\n");
     fprintf(stdout, "Examples:\n");
     fprintf(stdout, "\n");
     fprintf(stdout, "  Output a node status table:\n");
     fprintf(stdout, "    build/virtraft --servers 3 --iterations 1000 --tsv | column -t\n");
     fprintf(stdout, "\n");
+    fprintf(stdout, "  Stream metrics every 500 iterations:\n");
+    fprintf(stdout, "    build/virtraft --servers 5 --iterations 100000 --metrics metrics.tsv --metrics_interval 500\n");
+    fprintf(stdout, "\n");
+    fprintf(stdout, "  Trace a failing seed for ui.perfetto.dev or chrome://tracing:\n");
+    fprintf(stdout, "    build/virtraft --servers 5 --seed 42 --drop_rate 20 --iterations 5000 --trace trace.json\n");
+    fprintf(stdout, "\n");
 }
 
 static int parse_options(int argc, char **argv, options_t* options)
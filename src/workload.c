@@ -0,0 +1,157 @@
+#include <stdlib.h>
+#include <math.h>
+
+#include "workload.h"
+
+/* above this many arrivals per iteration a Poisson count is drawn from its
+ * normal approximation */
+#define POISSON_NORMAL_MIN 30
+
+/** @return uniform in (0, 1) */
+static double __uniform()
+{
+    return (random() + 1.0) / ((double)RAND_MAX + 2);
+}
+
+static int __poisson(double mean)
+{
+    if (POISSON_NORMAL_MIN < mean)
+    {
+        /* Box-Muller */
+        double z = sqrt(-2 * log(__uniform())) * cos(2 * M_PI * __uniform());
+        long n = lround(mean + sqrt(mean) * z);
+        return n < 0 ? 0 : n;
+    }
+
+    double limit = exp(-mean), p = __uniform();
+    int n = 0;
+    while (limit < p)
+    {
+        p *= __uniform();
+        n += 1;
+    }
+    return n;
+}
+
+/** n per 100 iterations, over 100 for several per iteration */
+static int __per_iter(int rate)
+{
+    return rate / 100 + (random() % 100 < rate % 100);
+}
+
+workload_t* workload_new(workload_config_t* config, int msec_per_iter)
+{
+    workload_config_t* c = config;
+    int i;
+
+    if (c->key_space < 1 ||
+        c->key_dist < WORKLOAD_KEYS_UNIFORM ||
+        WORKLOAD_KEYS_HOTSPOT < c->key_dist ||
+        c->zipf_theta < 0 ||
+        c->hot_keys < 0 || 100 < c->hot_keys ||
+        c->hot_ops < 0 || 100 < c->hot_ops ||
+        c->write_rate < 0 || c->read_rate < 0 ||
+        c->ops_per_sec < 0 || c->read_pct < 0 || 100 < c->read_pct ||
+        c->burst_every < 0 || c->burst_len < 0 || c->burst_factor < 1)
+        return NULL;
+
+    workload_t* me = calloc(1, sizeof(*me));
+    me->config = *config;
+    me->n_hot = (long)c->key_space * c->hot_keys / 100;
+    if (me->n_hot < 1)
+        me->n_hot = 1;
+    me->ops_per_iter = c->ops_per_sec * msec_per_iter / 1000;
+
+    if (WORKLOAD_KEYS_ZIPF == c->key_dist)
+    {
+        double sum = 0;
+        me->cdf = malloc(c->key_space * sizeof(double));
+        for (i = 0; i < c->key_space; i++)
+            me->cdf[i] = sum += pow(i + 1, -c->zipf_theta);
+        for (i = 0; i < c->key_space; i++)
+            me->cdf[i] /= sum;
+    }
+
+    return me;
+}
+
+void workload_free(workload_t* me)
+{
+    free(me->cdf);
+    free(me);
+}
+
+int workload_is_bursting(workload_t* me, long iter)
+{
+    return me->config.burst_every &&
+           iter % me->config.burst_every < me->config.burst_len;
+}
+
+void workload_arrivals(workload_t* me, long iter, int* n_writes, int* n_reads)
+{
+    int factor = workload_is_bursting(me, iter) ? me->config.burst_factor : 1;
+    int i;
+
+    if (me->ops_per_iter)
+    {
+        int n = __poisson(me->ops_per_iter * factor);
+        *n_reads = 0;
+        for (i = 0; i < n; i++)
+            *n_reads += random() % 100 < me->config.read_pct;
+        *n_writes = n - *n_reads;
+    }
+    else
+    {
+        *n_writes = 0;
+        *n_reads = 0;
+        for (i = 0; i < factor; i++)
+        {
+            *n_writes += __per_iter(me->config.write_rate);
+            if (me->config.read_rate)
+                *n_reads += __per_iter(me->config.read_rate);
+        }
+    }
+
+    me->n_writes += *n_writes;
+    me->n_reads += *n_reads;
+    if (1 < factor)
+        me->n_burst_ops += *n_writes + *n_reads;
+}
+
+/** @return the first key whose cdf is at least p */
+static int __zipf(workload_t* me, double p)
+{
+    int lo = 0, hi = me->config.key_space - 1;
+
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        if (me->cdf[mid] < p)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+int workload_key(workload_t* me, long iter)
+{
+    int key_space = me->config.key_space;
+    int key;
+
+    if (workload_is_bursting(me, iter))
+        key = random() % me->n_hot;
+    else if (WORKLOAD_KEYS_ZIPF == me->config.key_dist)
+        key = __zipf(me, __uniform());
+    else if (WORKLOAD_KEYS_HOTSPOT == me->config.key_dist &&
+             (me->n_hot == key_space || random() % 100 < me->config.hot_ops))
+        key = random() % me->n_hot;
+    else if (WORKLOAD_KEYS_HOTSPOT == me->config.key_dist)
+        key = me->n_hot + random() % (key_space - me->n_hot);
+    else
+        key = random() % key_space;
+
+    me->n_keys += 1;
+    me->n_hot_keys += key < me->n_hot;
+    return key;
+}
@@ -0,0 +1,97 @@
+/**
+ * In-process fuzzer for the command language of src/command_parser.rl.
+ *
+ * Each input is run against a fresh 5 server cluster, set up the way
+ * tests/test_fuzzer.py sets up virtraft, by handing its bytes straight to
+ * __execute(). Safety violations abort(), which the fuzzer reports as a
+ * crash.
+ *
+ * With libFuzzer (see the Makefile's fuzz target):
+ *
+ *   build/fuzz_commands_libfuzzer -dict=tests/commands.dict
+ *
+ * Built without -DLIBFUZZER, as waf builds it, main() runs each file named on
+ * the command line, or stdin if there are none, as one input, so that a crash
+ * can be reproduced and debugged without clang:
+ *
+ *   build/fuzz_commands crash-da39a3ee
+ */
+
+#include <stdint.h>
+
+#define main virtraft_main
+#include "../src/main.c"
+#undef main
+
+static char* __argv[] = {
+    "fuzz_commands", "--servers", "5", "--seed", "3", "--no_random_period",
+    "--quiet", NULL
+};
+
+/* the options are the same for every input; parsing them leaks the defaults
+ * they replace, so it's done before libFuzzer starts checking for leaks */
+int LLVMFuzzerInitialize(int* argc, char*** argv)
+{
+    if (-1 == parse_options(len(__argv) - 1, __argv, &opts))
+        abort();
+    raft_funcs.log_event = NULL;
+    return 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    struct path_parse pp;
+    parse_result_t result;
+
+    memset(&sys, 0, sizeof(sys));
+    __init_system(&sys);
+
+    __init(&pp, &sys, &result);
+    __execute(&pp, (const char*)data, size);
+    __finish(&pp);
+
+    __free_system(&sys);
+    return 0;
+}
+
+#ifndef LIBFUZZER
+static int __run(FILE* in)
+{
+    size_t size = 0, n;
+    char* data = malloc(4096);
+
+    while (0 < (n = fread(data + size, 1, 4096, in)))
+    {
+        size += n;
+        data = realloc(data, size + 4096);
+    }
+
+    LLVMFuzzerTestOneInput((uint8_t*)data, size);
+    free(data);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int i;
+
+    LLVMFuzzerInitialize(&argc, &argv);
+
+    if (1 == argc)
+        return __run(stdin);
+
+    for (i = 1; i < argc; i++)
+    {
+        FILE* in = fopen(argv[i], "rb");
+        if (!in)
+        {
+            perror(argv[i]);
+            return -1;
+        }
+        __run(in);
+        fclose(in);
+    }
+
+    return 0;
+}
+#endif